@@ -14,6 +14,7 @@
 #include "SymbolTable.h"
 #include "Symbols.h"
 #include "Writer.h"
+#include "lld/Core/Parallel.h"
 #include "lld/Driver/Driver.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/LibDriver/LibDriver.h"
@@ -287,6 +288,15 @@ void LinkerDriver::link(llvm::ArrayRef<const char *> ArgsArr) {
   if (Args.hasArg(OPT_verbose))
     Config->Verbose = true;
 
+  // Handle /threads
+  if (auto *Arg = Args.getLastArg(OPT_threads)) {
+    StringRef S = Arg->getValue();
+    unsigned N;
+    if (S.getAsInteger(10, N) || N == 0)
+      error(Twine("/threads: invalid number of threads: ") + S);
+    setDefaultExecutorThreadCount(N);
+  }
+
   // Handle /force or /force:unresolved
   if (Args.hasArg(OPT_force) || Args.hasArg(OPT_force_unresolved))
     Config->Force = true;
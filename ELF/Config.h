@@ -30,6 +30,9 @@ enum ELFKind {
   ELF64BEKind
 };
 
+// For --build-id.
+enum class BuildIdKind { None, Fnv1, Md5, Sha1, Hexstring, Uuid };
+
 // This struct contains the global configuration for the linker.
 // Most fields are direct mapping from the command line options
 // and such fields have the same name as the corresponding options.
@@ -39,6 +42,7 @@ struct Configuration {
   SymbolBody *MipsGpDisp = nullptr;
   SymbolBody *MipsLocalGp = nullptr;
   InputFile *FirstElf = nullptr;
+  llvm::StringRef ArchiveIndexCache;
   llvm::StringRef DynamicLinker;
   llvm::StringRef Entry;
   llvm::StringRef Emulation;
@@ -50,11 +54,12 @@ struct Configuration {
   std::string RPath;
   std::vector<llvm::StringRef> SearchPaths;
   std::vector<llvm::StringRef> Undefined;
+  std::vector<uint8_t> BuildIdVector;
   bool AllowMultipleDefinition;
   bool AsNeeded = false;
   bool Bsymbolic;
   bool BsymbolicFunctions;
-  bool BuildId;
+  bool BuildIdDebug;
   bool Demangle = true;
   bool DiscardAll;
   bool DiscardLocals;
@@ -65,12 +70,15 @@ struct Configuration {
   bool GcSections;
   bool GnuHash = false;
   bool ICF;
+  bool ICFData;
+  bool LazySharedSymbols;
   bool Mips64EL = false;
   bool NoUndefined;
   bool NoinhibitExec;
   bool Pic;
   bool Pie;
   bool PrintGcSections;
+  bool PrintIcfSections;
   bool Rela;
   bool Relocatable;
   bool SaveTemps;
@@ -87,6 +95,7 @@ struct Configuration {
   bool ZNow;
   bool ZOrigin;
   bool ZRelro;
+  BuildIdKind BuildId = BuildIdKind::None;
   ELFKind EKind = ELFNoneKind;
   uint16_t EMachine = llvm::ELF::EM_NONE;
   uint64_t EntryAddr = -1;
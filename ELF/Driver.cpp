@@ -16,8 +16,11 @@
 #include "SymbolTable.h"
 #include "Target.h"
 #include "Writer.h"
+#include "lld/Core/Parallel.h"
 #include "lld/Driver/Driver.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/raw_ostream.h"
 #include <utility>
@@ -69,7 +72,13 @@ static std::pair<ELFKind, uint16_t> parseEmulation(StringRef S) {
 
 // Returns slices of MB by parsing MB as an archive file.
 // Each slice consists of a member file in the archive.
-static std::vector<MemoryBufferRef> getArchiveMembers(MemoryBufferRef MB) {
+// Members of a thin archive are separate files, which are mapped by the
+// Archive object, so the Archive object is owned by this driver. Members
+// that are archives themselves, such as nested thin archives, are
+// expanded recursively. They are identified by their paths, so that the
+// members of a nested thin archive are found relative to its directory.
+std::vector<MemoryBufferRef>
+LinkerDriver::getArchiveMembers(MemoryBufferRef MB) {
   std::unique_ptr<Archive> File =
       check(Archive::create(MB), "failed to parse archive");
 
@@ -81,18 +90,34 @@ static std::vector<MemoryBufferRef> getArchiveMembers(MemoryBufferRef MB) {
         check(C.getMemoryBufferRef(),
               "could not get the buffer for a child of the archive " +
                   File->getFileName());
+    if (sys::fs::identify_magic(Mb.getBuffer()) ==
+        sys::fs::file_magic::archive) {
+      StringSaver Saver(Alloc);
+      StringRef Path =
+          Saver.save(getArchiveMemberPath(*File, Mb.getBufferIdentifier()));
+      std::vector<MemoryBufferRef> Nested =
+          getArchiveMembers(MemoryBufferRef(Mb.getBuffer(), Path));
+      V.insert(V.end(), Nested.begin(), Nested.end());
+      continue;
+    }
     V.push_back(Mb);
   }
+  OwningArchives.push_back(std::move(File));
   return V;
 }
 
 // Opens and parses a file. Path has to be resolved already.
 // Newly created memory buffers are owned by this driver.
 void LinkerDriver::addFile(StringRef Path) {
+  addFile(Path, MemoryBuffer::getFile(Path));
+}
+
+// Same as above, but for a file that has already been read.
+void LinkerDriver::addFile(StringRef Path,
+                           ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr) {
   using namespace llvm::sys::fs;
   if (Config->Verbose || Config->Trace)
     llvm::outs() << Path << "\n";
-  auto MBOrErr = MemoryBuffer::getFile(Path);
   if (!MBOrErr) {
     error(MBOrErr, "cannot open " + Path);
     return;
@@ -113,6 +138,14 @@ void LinkerDriver::addFile(StringRef Path) {
     }
     Files.push_back(make_unique<ArchiveFile>(MBRef));
     return;
+  case file_magic::elf_relocatable:
+    // Object files between --start-lib and --end-lib are loaded lazily.
+    if (InLib) {
+      Files.push_back(createLazyObjectFile(MBRef));
+      return;
+    }
+    Files.push_back(createObjectFile(MBRef));
+    return;
   case file_magic::elf_shared_object:
     if (Config->Relocatable) {
       error("attempted static link of dynamic object " + Path);
@@ -211,6 +244,26 @@ void LinkerDriver::main(ArrayRef<const char *> ArgsArr) {
   }
 }
 
+// Parses a hexadecimal string such as "deadbeef" for --build-id=0x<hex>.
+static std::vector<uint8_t> parseHex(StringRef S) {
+  if (S.empty() || S.size() % 2) {
+    error("--build-id: invalid hexadecimal string: 0x" + S);
+    return {};
+  }
+  std::vector<uint8_t> Hex;
+  while (!S.empty()) {
+    StringRef B = S.substr(0, 2);
+    S = S.substr(2);
+    uint8_t H;
+    if (B.getAsInteger(16, H)) {
+      error("not a hexadecimal value: " + B);
+      return {};
+    }
+    Hex.push_back(H);
+  }
+  return Hex;
+}
+
 // Initializes Config members by the command line options.
 void LinkerDriver::readConfigs(opt::InputArgList &Args) {
   for (auto *Arg : Args.filtered(OPT_L))
@@ -232,7 +285,8 @@ void LinkerDriver::readConfigs(opt::InputArgList &Args) {
   Config->AllowMultipleDefinition = Args.hasArg(OPT_allow_multiple_definition);
   Config->Bsymbolic = Args.hasArg(OPT_Bsymbolic);
   Config->BsymbolicFunctions = Args.hasArg(OPT_Bsymbolic_functions);
-  Config->BuildId = Args.hasArg(OPT_build_id);
+  Config->BuildIdDebug =
+      Args.hasFlag(OPT_build_id_debug, OPT_no_build_id_debug, false);
   Config->Demangle = !Args.hasArg(OPT_no_demangle);
   Config->DiscardAll = Args.hasArg(OPT_discard_all);
   Config->DiscardLocals = Args.hasArg(OPT_discard_locals);
@@ -242,10 +296,13 @@ void LinkerDriver::readConfigs(opt::InputArgList &Args) {
   Config->ExportDynamic = Args.hasArg(OPT_export_dynamic);
   Config->GcSections = Args.hasArg(OPT_gc_sections);
   Config->ICF = Args.hasArg(OPT_icf);
+  Config->ICFData = Args.hasArg(OPT_icf_data);
+  Config->LazySharedSymbols = Args.hasArg(OPT_lazy_shared_symbols);
   Config->NoUndefined = Args.hasArg(OPT_no_undefined);
   Config->NoinhibitExec = Args.hasArg(OPT_noinhibit_exec);
   Config->Pie = Args.hasArg(OPT_pie);
   Config->PrintGcSections = Args.hasArg(OPT_print_gc_sections);
+  Config->PrintIcfSections = Args.hasArg(OPT_print_icf_sections);
   Config->Relocatable = Args.hasArg(OPT_relocatable);
   Config->SaveTemps = Args.hasArg(OPT_save_temps);
   Config->Shared = Args.hasArg(OPT_shared);
@@ -255,6 +312,7 @@ void LinkerDriver::readConfigs(opt::InputArgList &Args) {
   Config->Verbose = Args.hasArg(OPT_verbose);
   Config->WarnCommon = Args.hasArg(OPT_warn_common);
 
+  Config->ArchiveIndexCache = getString(Args, OPT_archive_index_cache);
   Config->DynamicLinker = getString(Args, OPT_dynamic_linker);
   Config->Entry = getString(Args, OPT_entry);
   Config->Fini = getString(Args, OPT_fini, "_fini");
@@ -280,6 +338,41 @@ void LinkerDriver::readConfigs(opt::InputArgList &Args) {
       error("invalid optimization level");
   }
 
+  // --threads=N enables threads and limits their number. --threads=1 is
+  // the same as not using threads.
+  if (auto *Arg = Args.getLastArg(OPT_threads_eq)) {
+    StringRef Val = Arg->getValue();
+    unsigned N;
+    if (Val.getAsInteger(10, N) || N == 0) {
+      error("--threads: invalid number of threads: " + Val);
+    } else {
+      Config->Threads = N > 1;
+      setDefaultExecutorThreadCount(N);
+    }
+  }
+
+  if (auto *Arg = Args.getLastArg(OPT_build_id, OPT_build_id_eq)) {
+    if (Arg->getOption().getID() == OPT_build_id) {
+      Config->BuildId = BuildIdKind::Fnv1;
+    } else {
+      StringRef S = Arg->getValue();
+      if (S == "fast") {
+        Config->BuildId = BuildIdKind::Fnv1;
+      } else if (S == "md5") {
+        Config->BuildId = BuildIdKind::Md5;
+      } else if (S == "sha1") {
+        Config->BuildId = BuildIdKind::Sha1;
+      } else if (S == "uuid") {
+        Config->BuildId = BuildIdKind::Uuid;
+      } else if (S.startswith("0x")) {
+        Config->BuildId = BuildIdKind::Hexstring;
+        Config->BuildIdVector = parseHex(S.substr(2));
+      } else if (S != "none") {
+        error("unknown --build-id style: " + S);
+      }
+    }
+  }
+
   if (auto *Arg = Args.getLastArg(OPT_hash_style)) {
     StringRef S = Arg->getValue();
     if (S == "gnu") {
@@ -295,15 +388,86 @@ void LinkerDriver::readConfigs(opt::InputArgList &Args) {
     Config->Undefined.push_back(Arg->getValue());
 }
 
+// Returns the path of each input file given by Args, or an empty string
+// for other options and for libraries that cannot be found. Libraries are
+// searched for in the same way as createFiles() does.
+std::vector<StringRef>
+LinkerDriver::getInputPaths(ArrayRef<opt::Arg *> Args) {
+  StringSaver Saver(Alloc);
+  bool Static = Config->Static;
+  std::vector<StringRef> V;
+  for (opt::Arg *Arg : Args) {
+    switch (Arg->getOption().getID()) {
+    case OPT_l:
+      V.push_back(Saver.save(searchLibrary(Arg->getValue())));
+      continue;
+    case OPT_INPUT:
+    case OPT_script:
+      V.push_back(Arg->getValue());
+      continue;
+    case OPT_Bstatic:
+      Config->Static = true;
+      break;
+    case OPT_Bdynamic:
+      Config->Static = false;
+      break;
+    }
+    V.push_back("");
+  }
+  Config->Static = Static;
+  return V;
+}
+
+// Starts reading files into memory in the background. Unlike the
+// read-ahead in createFiles(), this does not wait for the files to be
+// handled, so archives whose members are read later are read as well.
+// All files are read by a single task, so that the tasks doing the
+// actual work are not queued behind one task per input file.
+void LinkerDriver::prefetch(ArrayRef<StringRef> Paths) {
+  std::vector<std::string> V;
+  for (StringRef Path : Paths)
+    if (!Path.empty())
+      V.push_back(Path);
+  Prefetcher.spawn([=] {
+    for (const std::string &S : V)
+      PrefetchedBytes += prefetchFile(S);
+  });
+}
+
+// The number of command line arguments whose files may be read ahead of
+// the one createFiles() is handling.
+static const size_t ReadAheadWindow = 16;
+
 void LinkerDriver::createFiles(opt::InputArgList &Args) {
-  for (auto *Arg : Args) {
+  std::vector<opt::Arg *> V(Args.begin(), Args.end());
+
+  // With --threads, input files are read by background tasks a few
+  // files ahead of the loop below, which still handles arguments in
+  // command line order. Files added by linker scripts are read when
+  // the scripts are processed.
+  std::vector<StringRef> Paths;
+  std::vector<Optional<ErrorOr<std::unique_ptr<MemoryBuffer>>>> Buffers;
+  if (Config->Threads) {
+    Paths = getInputPaths(V);
+    Buffers.resize(V.size());
+    prefetch(Paths);
+  }
+
+  auto Handle = [&](size_t I) {
+    opt::Arg *Arg = V[I];
     switch (Arg->getOption().getID()) {
     case OPT_l:
-      addLibrary(Arg->getValue());
+      if (!Buffers.empty() && Buffers[I])
+        addFile(Paths[I], std::move(*Buffers[I]));
+      else
+        addLibrary(Arg->getValue());
       break;
     case OPT_INPUT:
     case OPT_script:
-      addFile(Arg->getValue());
+      if (!Buffers.empty() && Buffers[I])
+        addFile(Paths[I], std::move(*Buffers[I]));
+      else
+        addFile(Arg->getValue());
       break;
     case OPT_as_needed:
       Config->AsNeeded = true;
@@ -323,7 +487,29 @@ void LinkerDriver::createFiles(opt::InputArgList &Args) {
     case OPT_no_whole_archive:
       WholeArchive = false;
       break;
+    case OPT_start_lib:
+      if (InLib)
+        error("nested --start-lib");
+      InLib = true;
+      break;
+    case OPT_end_lib:
+      if (!InLib)
+        error("stray --end-lib");
+      InLib = false;
+      break;
     }
+  };
+
+  if (Config->Threads) {
+    parallel_pipeline(size_t(0), V.size(), ReadAheadWindow,
+                      [&](size_t I) {
+                        if (!Paths[I].empty())
+                          Buffers[I] = MemoryBuffer::getFile(Paths[I]);
+                      },
+                      Handle);
+  } else {
+    for (size_t I = 0, E = V.size(); I != E; ++I)
+      Handle(I);
   }
 
   if (Files.empty() && !HasError)
@@ -338,6 +524,21 @@ template <class ELFT> static void initSymbols() {
   ElfSym<ELFT>::Ignored.setVisibility(STV_HIDDEN);
 }
 
+// Returns the total size of input files whose contents are used. Only
+// used archive members are counted, unlike prefetched bytes, which
+// include entire archives.
+template <class ELFT>
+static uint64_t getUsedBytes(SymbolTable<ELFT> &Symtab) {
+  uint64_t Size = 0;
+  for (const std::unique_ptr<ObjectFile<ELFT>> &F : Symtab.getObjectFiles())
+    Size += F->MB.getBufferSize();
+  for (const std::unique_ptr<SharedFile<ELFT>> &F : Symtab.getSharedFiles())
+    Size += F->MB.getBufferSize();
+  for (const std::unique_ptr<BitcodeFile> &F : Symtab.getBitcodeFiles())
+    Size += F->MB.getBufferSize();
+  return Size;
+}
+
 template <class ELFT> void LinkerDriver::link(opt::InputArgList &Args) {
   // For LTO
   InitializeAllTargets();
@@ -350,6 +551,7 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &Args) {
   SymbolTable<ELFT> Symtab;
   std::unique_ptr<TargetInfo> TI(createTarget());
   Target = TI.get();
+  Target->initRelFlags();
 
   Config->Rela = ELFT::Is64Bits;
 
@@ -399,14 +601,20 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &Args) {
     Symtab.addAbsolute("_gp", ElfSym<ELFT>::MipsGp);
   }
 
-  for (std::unique_ptr<InputFile> &F : Files)
-    Symtab.addFile(std::move(F));
+  Symtab.addFiles(Files);
   if (HasError)
     return; // There were duplicate symbols or incompatible files
 
   for (StringRef S : Config->Undefined)
     Symtab.addUndefinedOpt(S);
 
+  if (Config->Threads && Config->Verbose) {
+    Prefetcher.sync();
+    log("prefetched " + Twine(PrefetchedBytes.load()) +
+        " bytes of input files, used " + Twine(getUsedBytes(Symtab)) +
+        " bytes");
+  }
+
   Symtab.addCombinedLtoObject();
 
   for (auto *Arg : Args.filtered(OPT_wrap))
@@ -417,6 +625,9 @@ template <class ELFT> void LinkerDriver::link(opt::InputArgList &Args) {
 
   // Write the result to the file.
   Symtab.scanShlibUndefined();
+  Symtab.parseSections();
+  if (HasError)
+    return;
   if (Config->GcSections)
     markLive<ELFT>(&Symtab);
   if (Config->ICF)
@@ -12,9 +12,12 @@
 
 #include "SymbolTable.h"
 #include "lld/Core/LLVM.h"
+#include "lld/Core/Parallel.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Object/Archive.h"
 #include "llvm/Option/ArgList.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
 
 namespace lld {
 namespace elf {
@@ -28,14 +31,26 @@ public:
   void addLibrary(StringRef Name);
 
 private:
+  void addFile(StringRef Path,
+               llvm::ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr);
+  std::vector<StringRef> getInputPaths(ArrayRef<llvm::opt::Arg *> Args);
+  std::vector<MemoryBufferRef> getArchiveMembers(MemoryBufferRef MB);
+  void prefetch(ArrayRef<StringRef> Paths);
   void readConfigs(llvm::opt::InputArgList &Args);
   void createFiles(llvm::opt::InputArgList &Args);
   template <class ELFT> void link(llvm::opt::InputArgList &Args);
 
   llvm::BumpPtrAllocator Alloc;
   bool WholeArchive = false;
+  bool InLib = false;
   std::vector<std::unique_ptr<InputFile>> Files;
   std::vector<std::unique_ptr<MemoryBuffer>> OwningMBs;
+  std::vector<std::unique_ptr<llvm::object::Archive>> OwningArchives;
+
+  // Background tasks reading input files into memory, and the total size
+  // of the files they read.
+  std::atomic<uint64_t> PrefetchedBytes{0};
+  TaskGroup Prefetcher;
 };
 
 // Parses command line options.
@@ -62,6 +77,7 @@ void printVersion();
 std::string findFromSearchPaths(StringRef Path);
 std::string searchLibrary(StringRef Path);
 std::string buildSysrootedPath(llvm::StringRef Dir, llvm::StringRef File);
+uint64_t prefetchFile(StringRef Path);
 
 } // namespace elf
 } // namespace lld
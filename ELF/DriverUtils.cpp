@@ -19,9 +19,15 @@
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/StringSaver.h"
 
+#if defined(LLVM_ON_UNIX)
+#include <fcntl.h>
+#endif
+
 using namespace llvm;
 
 using namespace lld;
@@ -120,3 +126,35 @@ std::string elf::buildSysrootedPath(StringRef Dir, StringRef File) {
     sys::path::append(Path, Dir, File);
   return Path.str();
 }
+
+// Asks the OS to start reading a given file into memory, so that it is
+// already cached when the linker opens it. Returns the size of the file,
+// or 0 if the file cannot be opened.
+uint64_t elf::prefetchFile(StringRef Path) {
+  int FD;
+  if (sys::fs::openFileForRead(Path, FD))
+    return 0;
+  uint64_t Size = 0;
+  sys::fs::file_status Stat;
+  if (!sys::fs::status(FD, Stat))
+    Size = Stat.getSize();
+
+#if defined(POSIX_FADV_WILLNEED)
+  // The kernel reads the file asynchronously.
+  posix_fadvise(FD, 0, Size, POSIX_FADV_WILLNEED);
+#else
+  // Read the file by touching each page of a mapping of it.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+      MemoryBuffer::getOpenFile(FD, Path, Size, false);
+  if (MBOrErr) {
+    StringRef Buf = (*MBOrErr)->getBuffer();
+    volatile char Sink;
+    for (size_t I = 0; I < Buf.size(); I += sys::Process::getPageSize())
+      Sink = Buf[I];
+    (void)Sink;
+  }
+#endif
+
+  sys::Process::SafelyCloseFileDescriptor(FD);
+  return Size;
+}
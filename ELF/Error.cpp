@@ -12,6 +12,7 @@
 
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/raw_ostream.h"
+#include <mutex>
 
 namespace lld {
 namespace elf {
@@ -19,14 +20,21 @@ namespace elf {
 bool HasError;
 llvm::raw_ostream *ErrorOS;
 
+// Input files may be parsed in parallel, so messages are serialized.
+static std::mutex Mu;
+
 void log(const Twine &Msg) {
   if (Config->Verbose)
     llvm::outs() << Msg << "\n";
 }
 
-void warning(const Twine &Msg) { llvm::errs() << Msg << "\n"; }
+void warning(const Twine &Msg) {
+  std::lock_guard<std::mutex> Lock(Mu);
+  llvm::errs() << Msg << "\n";
+}
 
 void error(const Twine &Msg) {
+  std::lock_guard<std::mutex> Lock(Mu);
   *ErrorOS << Msg << "\n";
   HasError = true;
 }
@@ -37,6 +45,7 @@ void error(std::error_code EC, const Twine &Prefix) {
 }
 
 void fatal(const Twine &Msg) {
+  std::lock_guard<std::mutex> Lock(Mu);
   llvm::errs() << Msg << "\n";
   exit(1);
 }
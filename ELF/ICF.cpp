@@ -53,17 +53,33 @@
 // http://research.google.com/pubs/pub36912.html. (Note that what GNU
 // gold implemented is different from the optimistic algorithm.)
 //
+// With --icf-data, read-only data sections, including .data.rel.ro, are
+// folded only if their addresses are not taken and they define no exported
+// symbols, so that programs that compare addresses of distinct objects keep
+// working.
+//
+// If threads are enabled, equivalence classes are refined in parallel.
+// Each section has two slots for its class ID. An iteration reads IDs from
+// one slot and writes new IDs to the other, so a task never sees IDs that
+// other tasks are updating in the same iteration. Class IDs are derived from
+// the positions of sections in a vector rather than from a counter, so the
+// result does not depend on how the work is scheduled.
+//
 //===----------------------------------------------------------------------===//
 
 #include "ICF.h"
 #include "Config.h"
 #include "OutputSections.h"
 #include "SymbolTable.h"
+#include "Target.h"
 
+#include "lld/Core/Parallel.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/Hashing.h"
 #include "llvm/Object/ELF.h"
 #include "llvm/Support/ELF.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
 
 using namespace lld;
 using namespace lld::elf;
@@ -77,45 +93,40 @@ template <class ELFT> class ICF {
   typedef typename ELFT::Shdr Elf_Shdr;
   typedef typename ELFT::Sym Elf_Sym;
   typedef typename ELFT::uint uintX_t;
-  typedef Elf_Rel_Impl<ELFT, false> Elf_Rel;
-
-  using Comparator = std::function<bool(const InputSection<ELFT> *,
-                                        const InputSection<ELFT> *)>;
 
 public:
   void run(SymbolTable<ELFT> *Symtab);
 
 private:
-  uint64_t NextId = 1;
-
-  static void setLive(SymbolTable<ELFT> *S);
-  static uint64_t relSize(InputSection<ELFT> *S);
   static uint64_t getHash(InputSection<ELFT> *S);
-  static bool isEligible(InputSectionBase<ELFT> *Sec);
-  static std::vector<InputSection<ELFT> *> getSections(SymbolTable<ELFT> *S);
-  static SymbolBody &getSymbol(const InputSection<ELFT> *Sec,
-                               const Elf_Rel *Rel);
-
-  void segregate(InputSection<ELFT> **Begin, InputSection<ELFT> **End,
-                 Comparator Eq);
-
-  void forEachGroup(std::vector<InputSection<ELFT> *> &V, Comparator Eq);
+  static bool isDataSection(const Elf_Shdr &H, StringRef Name);
+  bool isEligible(InputSectionBase<ELFT> *Sec);
+  void findPinnedSections(SymbolTable<ELFT> *S);
+  std::vector<InputSection<ELFT> *> getSections(SymbolTable<ELFT> *S);
 
-  template <class RelTy>
-  static bool relocationEq(iterator_range<const RelTy *> RA,
-                           iterator_range<const RelTy *> RB);
+  void segregate(size_t Begin, size_t End, bool Constant);
 
-  template <class RelTy>
-  static bool variableEq(const InputSection<ELFT> *A,
-                         const InputSection<ELFT> *B,
-                         iterator_range<const RelTy *> RA,
-                         iterator_range<const RelTy *> RB);
+  template <class Fn> void forEachClass(Fn F);
 
   static bool equalsConstant(const InputSection<ELFT> *A,
                              const InputSection<ELFT> *B);
 
-  static bool equalsVariable(const InputSection<ELFT> *A,
-                             const InputSection<ELFT> *B);
+  bool equalsVariable(const InputSection<ELFT> *A,
+                      const InputSection<ELFT> *B) const;
+
+  // Sections subject to ICF. Sections in the same equivalence class
+  // are consecutive in this vector.
+  std::vector<InputSection<ELFT> *> Sections;
+
+  // Index of the GroupId slot holding the current class IDs.
+  int Cur = 0;
+
+  // True if the last iteration split any class.
+  std::atomic<bool> Changed;
+
+  // Data sections that must not be folded because their addresses are
+  // taken or because they define exported symbols.
+  llvm::DenseSet<InputSectionBase<ELFT> *> Pinned;
 };
 }
 }
@@ -124,12 +135,27 @@ private:
 // relocation targets is not included in the hash value.
 template <class ELFT> uint64_t ICF<ELFT>::getHash(InputSection<ELFT> *S) {
   uint64_t Flags = S->getSectionHdr()->sh_flags;
-  uint64_t H = hash_combine(Flags, S->getSize());
-  for (const Elf_Shdr *Rel : S->RelocSections)
-    H = hash_combine(H, (uint64_t)Rel->sh_size);
+  ArrayRef<uint8_t> Data = S->getSectionData();
+  hash_code H = hash_combine(Flags, S->getSize(), S->Relocations.size(),
+                             hash_combine_range(Data.begin(), Data.end()));
+  for (const Relocation<ELFT> &Rel : S->Relocations)
+    H = hash_combine(H, Rel.Offset, Rel.Type, Rel.Addend);
   return H;
 }
 
+// Returns true if a section with header H is a read-only data section
+// that --icf-data may fold. .data.rel.ro sections are writable only
+// until the dynamic linker has applied relocations.
+template <class ELFT>
+bool ICF<ELFT>::isDataSection(const Elf_Shdr &H, StringRef Name) {
+  if (!(H.sh_flags & SHF_ALLOC) || (H.sh_flags & SHF_EXECINSTR))
+    return false;
+  if (H.sh_type != SHT_PROGBITS)
+    return false;
+  return (~H.sh_flags & SHF_WRITE) || Name == ".data.rel.ro" ||
+         Name.startswith(".data.rel.ro.");
+}
+
 // Returns true if Sec is subject of ICF.
 template <class ELFT> bool ICF<ELFT>::isEligible(InputSectionBase<ELFT> *Sec) {
   if (!Sec || Sec == InputSection<ELFT>::Discarded || !Sec->Live)
@@ -146,9 +172,57 @@ template <class ELFT> bool ICF<ELFT>::isEligible(InputSectionBase<ELFT> *Sec) {
     return false;
 
   const Elf_Shdr &H = *S->getSectionHdr();
+  if (Config->ICFData && isDataSection(H, Name))
+    return !Pinned.count(S);
   return (H.sh_flags & SHF_ALLOC) && (~H.sh_flags & SHF_WRITE);
 }
 
+// Finds data sections whose addresses may be observed by the program and
+// adds them to Pinned. That is the case if a section defines a symbol that
+// is exported, or if a section is referred to by any relocation other than
+// one that the target can prove to be a load from code, since for example
+// "leaq foo(%rip)" uses the same relocation as "movq foo(%rip)".
+template <class ELFT>
+void ICF<ELFT>::findPinnedSections(SymbolTable<ELFT> *Symtab) {
+  for (Symbol *S : Symtab->getSymbols()) {
+    SymbolBody *B = S->Body;
+    uint8_t V = B->getVisibility();
+    if (V != STV_DEFAULT && V != STV_PROTECTED)
+      continue;
+    if (!Config->Shared && !Config->ExportDynamic && !B->MustBeInDynSym)
+      continue;
+    if (auto *D = dyn_cast<DefinedRegular<ELFT>>(B))
+      if (D->Section)
+        Pinned.insert(D->Section);
+  }
+
+  for (const std::unique_ptr<ObjectFile<ELFT>> &F : Symtab->getObjectFiles()) {
+    for (InputSectionBase<ELFT> *Sec : F->getSections()) {
+      auto *S = dyn_cast_or_null<InputSection<ELFT>>(Sec);
+      if (!S || S == InputSection<ELFT>::Discarded || !S->Live)
+        continue;
+      // References from non-alloc sections, such as debug info, do not
+      // make addresses observable, as with ICF for code.
+      uintX_t Flags = S->getSectionHdr()->sh_flags;
+      if (!(Flags & SHF_ALLOC))
+        continue;
+      bool IsCode = Flags & SHF_EXECINSTR;
+      ArrayRef<uint8_t> Data = S->getSectionData();
+      for (const Relocation<ELFT> &Rel : S->Relocations) {
+        InputSectionBase<ELFT> *Dest = S->getRelocTarget(Rel);
+        if (!Dest)
+          continue;
+        SymbolBody &Body = Rel.Sym->repl();
+        if (IsCode && Target->isLoad(Rel.Type, Data, Rel.Offset) &&
+            !Target->needsGot(Rel.Type, Body) &&
+            Target->needsPlt(Rel.Type, Body) == TargetInfo::Plt_No)
+          continue;
+        Pinned.insert(Dest);
+      }
+    }
+  }
+}
+
 template <class ELFT>
 std::vector<InputSection<ELFT> *>
 ICF<ELFT>::getSections(SymbolTable<ELFT> *Symtab) {
@@ -160,66 +234,61 @@ ICF<ELFT>::getSections(SymbolTable<ELFT> *Symtab) {
   return V;
 }
 
+// All sections in Sections[Begin, End) must have the same class ID before
+// you call this function. This function compares the sections using
+// equalsConstant or equalsVariable and writes new class IDs for them.
+// It only touches sections in the given range, so ranges of different
+// classes can be processed in parallel.
 template <class ELFT>
-SymbolBody &ICF<ELFT>::getSymbol(const InputSection<ELFT> *Sec,
-                                 const Elf_Rel *Rel) {
-  uint32_t SymIdx = Rel->getSymbol(Config->Mips64EL);
-  return Sec->File->getSymbolBody(SymIdx).repl();
-}
+void ICF<ELFT>::segregate(size_t Begin, size_t End, bool Constant) {
+  int Next = 1 - Cur;
 
-// All sections between Begin and End must have the same group ID before
-// you call this function. This function compare sections between Begin
-// and End using Eq and assign new group IDs for new groups.
-template <class ELFT>
-void ICF<ELFT>::segregate(InputSection<ELFT> **Begin, InputSection<ELFT> **End,
-                          Comparator Eq) {
   // This loop rearranges [Begin, End) so that all sections that are
-  // equal in terms of Eq are contiguous. The algorithm is quadratic in
-  // the worst case, but that is not an issue in practice because the
-  // number of distinct sections in [Begin, End) is usually very small.
-  InputSection<ELFT> **I = Begin;
-  for (;;) {
-    InputSection<ELFT> *Head = *I;
+  // equal in terms of equals{Constant,Variable} are contiguous. The
+  // algorithm is quadratic in the worst case, but that is not an issue
+  // in practice because the number of distinct sections in [Begin, End)
+  // is usually very small.
+  while (Begin < End) {
+    InputSection<ELFT> *Head = Sections[Begin];
     auto Bound = std::stable_partition(
-        I + 1, End, [&](InputSection<ELFT> *S) { return Eq(Head, S); });
-    if (Bound == End)
-      return;
-    uint64_t Id = NextId++;
-    for (; I != Bound; ++I)
-      (*I)->GroupId = Id;
+        Sections.begin() + Begin + 1, Sections.begin() + End,
+        [&](InputSection<ELFT> *S) {
+          return Constant ? equalsConstant(Head, S) : equalsVariable(Head, S);
+        });
+    size_t Mid = Bound - Sections.begin();
+    if (Mid != End)
+      Changed = true;
+
+    // A class is identified by the position of its first member, which is
+    // unique and independent of the order in which classes are processed.
+    // IDs are offset by one because zero means "not subject to ICF".
+    for (size_t I = Begin; I < Mid; ++I)
+      Sections[I]->GroupId[Next] = Begin + 1;
+    Begin = Mid;
   }
 }
 
+// Calls F for each range of sections that share the current class ID and
+// then makes the IDs written by F current.
 template <class ELFT>
-void ICF<ELFT>::forEachGroup(std::vector<InputSection<ELFT> *> &V,
-                             Comparator Eq) {
-  for (InputSection<ELFT> **I = V.data(), **E = I + V.size(); I != E;) {
-    InputSection<ELFT> *Head = *I;
-    auto Bound = std::find_if(I + 1, E, [&](InputSection<ELFT> *S) {
-      return S->GroupId != Head->GroupId;
-    });
-    segregate(I, Bound, Eq);
-    I = Bound;
+template <class Fn>
+void ICF<ELFT>::forEachClass(Fn F) {
+  std::vector<std::pair<size_t, size_t>> Ranges;
+  for (size_t I = 0, E = Sections.size(); I != E;) {
+    uint64_t Id = Sections[I]->GroupId[Cur];
+    size_t J = I + 1;
+    while (J != E && Sections[J]->GroupId[Cur] == Id)
+      ++J;
+    Ranges.push_back({I, J});
+    I = J;
   }
-}
 
-// Compare two lists of relocations.
-template <class ELFT>
-template <class RelTy>
-bool ICF<ELFT>::relocationEq(iterator_range<const RelTy *> RelsA,
-                             iterator_range<const RelTy *> RelsB) {
-  const RelTy *IA = RelsA.begin();
-  const RelTy *EA = RelsA.end();
-  const RelTy *IB = RelsB.begin();
-  const RelTy *EB = RelsB.end();
-  if (EA - IA != EB - IB)
-    return false;
-  for (; IA != EA; ++IA, ++IB)
-    if (IA->r_offset != IB->r_offset ||
-        IA->getType(Config->Mips64EL) != IB->getType(Config->Mips64EL) ||
-        getAddend<ELFT>(*IA) != getAddend<ELFT>(*IB))
-      return false;
-  return true;
+  auto Fn2 = [&](const std::pair<size_t, size_t> &R) { F(R.first, R.second); };
+  if (Config->Threads)
+    parallel_for_each(Ranges.begin(), Ranges.end(), Fn2);
+  else
+    std::for_each(Ranges.begin(), Ranges.end(), Fn2);
+  Cur = 1 - Cur;
 }
 
 // Compare "non-moving" part of two InputSections, namely everything
@@ -227,21 +296,14 @@ bool ICF<ELFT>::relocationEq(iterator_range<const RelTy *> RelsA,
 template <class ELFT>
 bool ICF<ELFT>::equalsConstant(const InputSection<ELFT> *A,
                                const InputSection<ELFT> *B) {
-  if (A->RelocSections.size() != B->RelocSections.size())
+  if (A->Relocations.size() != B->Relocations.size())
     return false;
 
-  for (size_t I = 0, E = A->RelocSections.size(); I != E; ++I) {
-    const Elf_Shdr *RA = A->RelocSections[I];
-    const Elf_Shdr *RB = B->RelocSections[I];
-    ELFFile<ELFT> &FileA = A->File->getObj();
-    ELFFile<ELFT> &FileB = B->File->getObj();
-    if (RA->sh_type == SHT_RELA) {
-      if (!relocationEq(FileA.relas(RA), FileB.relas(RB)))
-        return false;
-    } else {
-      if (!relocationEq(FileA.rels(RA), FileB.rels(RB)))
-        return false;
-    }
+  for (size_t I = 0, E = A->Relocations.size(); I != E; ++I) {
+    const Relocation<ELFT> &RA = A->Relocations[I];
+    const Relocation<ELFT> &RB = B->Relocations[I];
+    if (RA.Offset != RB.Offset || RA.Type != RB.Type || RA.Addend != RB.Addend)
+      return false;
   }
 
   return A->getSectionHdr()->sh_flags == B->getSectionHdr()->sh_flags &&
@@ -249,23 +311,18 @@ bool ICF<ELFT>::equalsConstant(const InputSection<ELFT> *A,
          A->getSectionData() == B->getSectionData();
 }
 
+// Compare "moving" part of two InputSections, namely relocation targets.
 template <class ELFT>
-template <class RelTy>
-bool ICF<ELFT>::variableEq(const InputSection<ELFT> *A,
-                           const InputSection<ELFT> *B,
-                           iterator_range<const RelTy *> RelsA,
-                           iterator_range<const RelTy *> RelsB) {
-  const RelTy *IA = RelsA.begin();
-  const RelTy *EA = RelsA.end();
-  const RelTy *IB = RelsB.begin();
-  for (; IA != EA; ++IA, ++IB) {
-    SymbolBody &SA = getSymbol(A, (const Elf_Rel *)IA);
-    SymbolBody &SB = getSymbol(B, (const Elf_Rel *)IB);
+bool ICF<ELFT>::equalsVariable(const InputSection<ELFT> *A,
+                               const InputSection<ELFT> *B) const {
+  for (size_t I = 0, E = A->Relocations.size(); I != E; ++I) {
+    SymbolBody &SA = A->Relocations[I].Sym->repl();
+    SymbolBody &SB = B->Relocations[I].Sym->repl();
     if (&SA == &SB)
       continue;
 
     // Or, the symbols should be pointing to the same section
-    // in terms of the group ID.
+    // in terms of the class ID.
     auto *DA = dyn_cast<DefinedRegular<ELFT>>(&SA);
     auto *DB = dyn_cast<DefinedRegular<ELFT>>(&SB);
     if (!DA || !DB)
@@ -274,76 +331,77 @@ bool ICF<ELFT>::variableEq(const InputSection<ELFT> *A,
       return false;
     InputSection<ELFT> *X = dyn_cast<InputSection<ELFT>>(DA->Section);
     InputSection<ELFT> *Y = dyn_cast<InputSection<ELFT>>(DB->Section);
-    if (X && Y && X->GroupId && X->GroupId == Y->GroupId)
+    if (X && Y && X->GroupId[Cur] && X->GroupId[Cur] == Y->GroupId[Cur])
       continue;
     return false;
   }
   return true;
 }
 
-// Compare "moving" part of two InputSections, namely relocation targets.
-template <class ELFT>
-bool ICF<ELFT>::equalsVariable(const InputSection<ELFT> *A,
-                               const InputSection<ELFT> *B) {
-  for (size_t I = 0, E = A->RelocSections.size(); I != E; ++I) {
-    const Elf_Shdr *RA = A->RelocSections[I];
-    const Elf_Shdr *RB = B->RelocSections[I];
-    ELFFile<ELFT> &FileA = A->File->getObj();
-    ELFFile<ELFT> &FileB = B->File->getObj();
-    if (RA->sh_type == SHT_RELA) {
-      if (!variableEq(A, B, FileA.relas(RA), FileB.relas(RB)))
-        return false;
-    } else {
-      if (!variableEq(A, B, FileA.rels(RA), FileB.rels(RB)))
-        return false;
-    }
-  }
-  return true;
-}
-
 // The main function of ICF.
 template <class ELFT> void ICF<ELFT>::run(SymbolTable<ELFT> *Symtab) {
-  // Initially, we use hash values as section group IDs. Therefore,
+  // Initially, we use hash values as section class IDs. Therefore,
   // if two sections have the same ID, they are likely (but not
   // guaranteed) to have the same static contents in terms of ICF.
-  std::vector<InputSection<ELFT> *> V = getSections(Symtab);
-  for (InputSection<ELFT> *S : V)
-    // Set MSB on to avoid collisions with serial group IDs
-    S->GroupId = getHash(S) | (uint64_t(1) << 63);
-
-  // From now on, sections in V are ordered so that sections in
-  // the same group are consecutive in the vector.
-  std::stable_sort(V.begin(), V.end(),
-                   [](InputSection<ELFT> *A, InputSection<ELFT> *B) {
-                     return A->GroupId < B->GroupId;
-                   });
+  if (Config->ICFData)
+    findPinnedSections(Symtab);
+  Sections = getSections(Symtab);
+  auto SetHash = [&](InputSection<ELFT> *S) {
+    // Set MSB on to avoid collisions with position-based class IDs.
+    S->GroupId[Cur] = getHash(S) | (uint64_t(1) << 63);
+  };
+  if (Config->Threads)
+    parallel_for_each(Sections.begin(), Sections.end(), SetHash);
+  else
+    std::for_each(Sections.begin(), Sections.end(), SetHash);
+
+  // From now on, sections are ordered so that sections in the same
+  // class are consecutive in the vector. Ties are broken by the original
+  // position so that the order does not depend on the sort algorithm.
+  std::vector<std::pair<uint64_t, size_t>> Keys(Sections.size());
+  for (size_t I = 0, E = Sections.size(); I != E; ++I)
+    Keys[I] = {Sections[I]->GroupId[Cur], I};
+  if (Config->Threads)
+    parallel_sort(Keys.data(), Keys.data() + Keys.size());
+  else
+    std::sort(Keys.begin(), Keys.end());
+  std::vector<InputSection<ELFT> *> Sorted(Sections.size());
+  for (size_t I = 0, E = Keys.size(); I != E; ++I)
+    Sorted[I] = Sections[Keys[I].second];
+  Sections = std::move(Sorted);
 
   // Compare static contents and assign unique IDs for each static content.
-  forEachGroup(V, equalsConstant);
+  forEachClass([&](size_t Begin, size_t End) { segregate(Begin, End, true); });
 
-  // Split groups by comparing relocations until we get a convergence.
+  // Split classes by comparing relocations until we get a convergence.
   int Cnt = 1;
-  for (;;) {
+  do {
     ++Cnt;
-    uint64_t Id = NextId;
-    forEachGroup(V, equalsVariable);
-    if (Id == NextId)
-      break;
-  }
+    Changed = false;
+    forEachClass(
+        [&](size_t Begin, size_t End) { segregate(Begin, End, false); });
+  } while (Changed);
   log("ICF needed " + Twine(Cnt) + " iterations.");
 
-  // Merge sections in the same group.
-  for (auto I = V.begin(), E = V.end(); I != E;) {
+  // Merge sections in the same class.
+  for (auto I = Sections.begin(), E = Sections.end(); I != E;) {
     InputSection<ELFT> *Head = *I++;
     auto Bound = std::find_if(I, E, [&](InputSection<ELFT> *S) {
-      return Head->GroupId != S->GroupId;
+      return Head->GroupId[Cur] != S->GroupId[Cur];
     });
     if (I == Bound)
       continue;
     log("selected " + Head->getSectionName());
+    if (Config->PrintIcfSections)
+      llvm::errs() << "selected section '" << Head->getSectionName()
+                   << "' in file '" << Head->getFile()->getName() << "'\n";
     while (I != Bound) {
       InputSection<ELFT> *S = *I++;
       log("  removed " + S->getSectionName());
+      if (Config->PrintIcfSections)
+        llvm::errs() << "  removing identical section '"
+                     << S->getSectionName() << "' in file '"
+                     << S->getFile()->getName() << "'\n";
       Head->replace(S);
     }
   }
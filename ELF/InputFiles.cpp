@@ -15,6 +15,9 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Object/IRObjectFile.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
@@ -108,11 +111,52 @@ template <class ELFT> uint32_t elf::ObjectFile<ELFT>::getMipsGp0() const {
   return 0;
 }
 
+// Read section and symbol tables. This function does not depend on
+// any other files, so it is safe to call it for multiple files in parallel.
+// Only section headers are read here. Section contents are read by
+// parseSections() once it is known which comdat groups are kept.
+template <class ELFT> void elf::ObjectFile<ELFT>::preparse() {
+  initializeSections();
+  initializeSymbols();
+  Preparsed = true;
+}
+
 template <class ELFT>
 void elf::ObjectFile<ELFT>::parse(DenseSet<StringRef> &ComdatGroups) {
-  // Read section and symbol tables.
-  initializeSections(ComdatGroups);
-  initializeSymbols();
+  if (!Preparsed)
+    preparse();
+  discardComdatGroups(ComdatGroups);
+}
+
+// Comdat groups are deduplicated by name; only the first group seen
+// in command line order is kept. Sections of the other groups are
+// discarded, and symbols defined in them are re-created as undefined
+// symbols, as if the sections were discarded while being read.
+template <class ELFT>
+void elf::ObjectFile<ELFT>::discardComdatGroups(
+    DenseSet<StringRef> &ComdatGroups) {
+  bool Discarded = false;
+  for (std::pair<StringRef, const Elf_Shdr *> &P : ComdatGroupSections) {
+    if (ComdatGroups.insert(P.first).second)
+      continue;
+    for (uint32_t SecIndex : getShtGroupEntries(*P.second)) {
+      if (SecIndex >= Sections.size())
+        fatal("invalid section index in group");
+      if (Sections[SecIndex] == MipsReginfo)
+        MipsReginfo = nullptr;
+      Sections[SecIndex] = InputSection<ELFT>::Discarded;
+    }
+    Discarded = true;
+  }
+  if (!Discarded)
+    return;
+
+  uint32_t I = 0;
+  for (const Elf_Sym &Sym : this->getElfSymbols(false)) {
+    if (getSection(Sym) == InputSection<ELFT>::Discarded)
+      SymbolBodies[I] = createSymbolBody(&Sym);
+    ++I;
+  }
 }
 
 // Sections with SHT_GROUP and comdat bits define comdat section groups.
@@ -145,11 +189,12 @@ template <class ELFT> static bool shouldMerge(const typename ELFT::Shdr &Sec) {
   uintX_t Flags = Sec.sh_flags;
   if (!(Flags & SHF_MERGE))
     return false;
-  if (Flags & SHF_WRITE)
-    fatal("writable SHF_MERGE sections are not supported");
+
+  // Invalid SHF_MERGE sections are reported by splitIntoPieces(), so that
+  // they are not reported if they are in discarded comdat groups.
   uintX_t EntSize = Sec.sh_entsize;
-  if (!EntSize || Sec.sh_size % EntSize)
-    fatal("SHF_MERGE section size must be a multiple of sh_entsize");
+  if ((Flags & SHF_WRITE) || !EntSize || Sec.sh_size % EntSize)
+    return true;
 
   // Don't try to merge if the aligment is larger than the sh_entsize and this
   // is not SHF_STRINGS.
@@ -166,9 +211,7 @@ template <class ELFT> static bool shouldMerge(const typename ELFT::Shdr &Sec) {
   return true;
 }
 
-template <class ELFT>
-void elf::ObjectFile<ELFT>::initializeSections(
-    DenseSet<StringRef> &ComdatGroups) {
+template <class ELFT> void elf::ObjectFile<ELFT>::initializeSections() {
   uint64_t Size = this->ELFObj.getNumSections();
   Sections.resize(Size);
   unsigned I = -1;
@@ -181,13 +224,7 @@ void elf::ObjectFile<ELFT>::initializeSections(
     switch (Sec.sh_type) {
     case SHT_GROUP:
       Sections[I] = InputSection<ELFT>::Discarded;
-      if (ComdatGroups.insert(getShtGroupSignature(Sec)).second)
-        continue;
-      for (uint32_t SecIndex : getShtGroupEntries(Sec)) {
-        if (SecIndex >= Size)
-          fatal("invalid section index in group");
-        Sections[SecIndex] = InputSection<ELFT>::Discarded;
-      }
+      ComdatGroupSections.emplace_back(getShtGroupSignature(Sec), &Sec);
       break;
     case SHT_SYMTAB:
       this->Symtab = &Sec;
@@ -199,38 +236,66 @@ void elf::ObjectFile<ELFT>::initializeSections(
     case SHT_NULL:
       break;
     case SHT_RELA:
-    case SHT_REL: {
+    case SHT_REL:
       // This section contains relocation information.
       // If -r is given, we do not interpret or apply relocation
       // but just copy relocation sections to output.
-      if (Config->Relocatable) {
+      // Otherwise, it is associated with the section it relocates
+      // by parseSections().
+      if (Config->Relocatable)
         Sections[I] = new (Alloc) InputSection<ELFT>(this, &Sec);
-        break;
-      }
-
-      // Find the relocation target section and associate this
-      // section with it.
-      InputSectionBase<ELFT> *Target = getRelocTarget(Sec);
-      if (!Target)
-        break;
-      if (auto *S = dyn_cast<InputSection<ELFT>>(Target)) {
-        S->RelocSections.push_back(&Sec);
-        break;
-      }
-      if (auto *S = dyn_cast<EHInputSection<ELFT>>(Target)) {
-        if (S->RelocSection)
-          fatal("multiple relocation sections to .eh_frame are not supported");
-        S->RelocSection = &Sec;
-        break;
-      }
-      fatal("relocations pointing to SHF_MERGE are not supported");
-    }
+      break;
     default:
       Sections[I] = createInputSection(Sec);
     }
   }
 }
 
+// Reads the contents of the sections that are not discarded: associates
+// relocation sections with the sections they relocate, splits SHF_MERGE
+// sections into pieces and decodes relocations. This is called after
+// comdat groups are deduplicated, so sections of discarded groups are
+// never read. It does not depend on any other files, so it is safe to
+// call it for multiple files in parallel.
+template <class ELFT> void elf::ObjectFile<ELFT>::parseSections() {
+  unsigned I = -1;
+  for (const Elf_Shdr &Sec : this->ELFObj.sections()) {
+    ++I;
+    InputSectionBase<ELFT> *S = Sections[I];
+    if (S == InputSection<ELFT>::Discarded)
+      continue;
+    if (&Sec == SplitStackSec)
+      error("objects using splitstacks are not supported");
+    if (!S && (Sec.sh_type == SHT_RELA || Sec.sh_type == SHT_REL))
+      initializeRelocSection(Sec);
+    else if (auto *MS = dyn_cast_or_null<MergeInputSection<ELFT>>(S))
+      MS->splitIntoPieces();
+  }
+
+  for (InputSectionBase<ELFT> *S : Sections)
+    if (S && S != InputSectionBase<ELFT>::Discarded)
+      S->initRelocations();
+}
+
+// Associates a relocation section with the section it relocates.
+template <class ELFT>
+void elf::ObjectFile<ELFT>::initializeRelocSection(const Elf_Shdr &Sec) {
+  InputSectionBase<ELFT> *Target = getRelocTarget(Sec);
+  if (!Target)
+    return;
+  if (auto *S = dyn_cast<InputSection<ELFT>>(Target)) {
+    S->RelocSections.push_back(&Sec);
+    return;
+  }
+  if (auto *S = dyn_cast<EHInputSection<ELFT>>(Target)) {
+    if (S->RelocSection)
+      fatal("multiple relocation sections to .eh_frame are not supported");
+    S->RelocSection = &Sec;
+    return;
+  }
+  fatal("relocations pointing to SHF_MERGE are not supported");
+}
+
 template <class ELFT>
 InputSectionBase<ELFT> *
 elf::ObjectFile<ELFT>::getRelocTarget(const Elf_Shdr &Sec) {
@@ -262,8 +327,10 @@ elf::ObjectFile<ELFT>::createInputSection(const Elf_Shdr &Sec) {
   if (Name == ".note.GNU-stack")
     return InputSection<ELFT>::Discarded;
 
+  // Objects using split stacks are reported by parseSections(), so that
+  // they are not reported if the section is in a discarded comdat group.
   if (Name == ".note.GNU-split-stack")
-    error("objects using splitstacks are not supported");
+    SplitStackSec = &Sec;
 
   // A MIPS object file has a special section that contains register
   // usage info, which needs to be handled by the linker specially.
@@ -337,9 +404,81 @@ SymbolBody *elf::ObjectFile<ELFT>::createSymbolBody(const Elf_Sym *Sym) {
   }
 }
 
+// With --archive-index-cache, the symbols of each archive are cached in a
+// file, along with their hash values and the offsets of the members
+// defining them. A cache file is named after a hash of the archive's path,
+// size and modification time, and it is used only if the size and the
+// time recorded in it still match and its contents match the checksum in
+// its header. It is memory-mapped, so a cached
+// archive is added to the symbol table without parsing its symbol table
+// or hashing its symbol names.
+//
+// A cache file consists of a header, NumSymbols entries and a string
+// table containing the symbol names.
+namespace {
+struct IndexCacheHeader {
+  char Magic[8];
+  support::ulittle64_t ArchiveSize;
+  support::ulittle64_t ArchiveMTime;
+  support::ulittle32_t NumSymbols;
+  support::ulittle32_t StrTabSize;
+  // The first 8 bytes of the MD5 hash of the entries and the string table.
+  support::ulittle64_t Checksum;
+};
+
+struct IndexCacheEntry {
+  support::ulittle64_t MemberOffset;
+  support::ulittle32_t NameOffset;
+  support::ulittle32_t NameSize;
+  support::ulittle32_t NameHash;
+  support::ulittle32_t Padding;
+};
+}
+
+static const char IndexCacheMagic[] = "LLDAIDX2";
+
+static uint64_t getIndexCacheChecksum(StringRef Entries, StringRef StrTab) {
+  MD5 Hash;
+  Hash.update(Entries);
+  Hash.update(StrTab);
+  MD5::MD5Result Res;
+  Hash.final(Res);
+  return support::endian::read64le(Res);
+}
+
+static std::string getIndexCachePath(StringRef ArchivePath, uint64_t Size,
+                                     uint64_t MTime) {
+  SmallString<128> Abs = ArchivePath;
+  make_absolute(Abs);
+  MD5 Hash;
+  Hash.update((Abs + ":" + Twine(Size) + ":" + Twine(MTime)).str());
+  MD5::MD5Result Res;
+  Hash.final(Res);
+  SmallString<32> Key;
+  MD5::stringifyResult(Res, Key);
+
+  SmallString<128> Path = Config->ArchiveIndexCache;
+  sys::path::append(Path, Key + ".idx");
+  return Path.str();
+}
+
 void ArchiveFile::parse() {
   File = check(Archive::create(MB), "failed to parse archive");
 
+  // Use the archive index cache if it is enabled and up to date.
+  std::string CachePath;
+  uint64_t Size = 0;
+  uint64_t MTime = 0;
+  file_status Stat;
+  if (!Config->ArchiveIndexCache.empty() && !status(getName(), Stat)) {
+    sys::TimeValue T = Stat.getLastModificationTime();
+    Size = Stat.getSize();
+    MTime = T.toEpochTime() * 1000000000 + T.nanoseconds();
+    CachePath = getIndexCachePath(getName(), Size, MTime);
+    if (readIndexCache(CachePath, Size, MTime))
+      return;
+  }
+
   // Allocate a buffer for Lazy objects.
   size_t NumSyms = File->getNumberOfSymbols();
   LazySymbols.reserve(NumSyms);
@@ -347,6 +486,105 @@ void ArchiveFile::parse() {
   // Read the symbol table to construct Lazy objects.
   for (const Archive::Symbol &Sym : File->symbols())
     LazySymbols.emplace_back(this, Sym);
+
+  if (!CachePath.empty())
+    writeIndexCache(CachePath, Size, MTime);
+}
+
+// Reads symbols from a given cache file. Returns false if the file does
+// not exist, is corrupted or is for a different version of the archive.
+bool ArchiveFile::readIndexCache(StringRef Path, uint64_t Size,
+                                 uint64_t MTime) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> MBOrErr =
+      MemoryBuffer::getFile(Path, -1, false);
+  if (!MBOrErr)
+    return false;
+  StringRef Buf = (*MBOrErr)->getBuffer();
+  if (Buf.size() < sizeof(IndexCacheHeader))
+    return false;
+
+  auto *Hdr = reinterpret_cast<const IndexCacheHeader *>(Buf.data());
+  if (memcmp(Hdr->Magic, IndexCacheMagic, sizeof(Hdr->Magic)) != 0 ||
+      Hdr->ArchiveSize != Size || Hdr->ArchiveMTime != MTime)
+    return false;
+  uint64_t StrTabOffset = sizeof(IndexCacheHeader) +
+                          uint64_t(Hdr->NumSymbols) * sizeof(IndexCacheEntry);
+  if (StrTabOffset + Hdr->StrTabSize != Buf.size())
+    return false;
+  StringRef StrTab = Buf.substr(StrTabOffset);
+  if (getIndexCacheChecksum(Buf.slice(sizeof(IndexCacheHeader), StrTabOffset),
+                            StrTab) != Hdr->Checksum)
+    return false;
+
+  ArrayRef<IndexCacheEntry> Entries(
+      reinterpret_cast<const IndexCacheEntry *>(Buf.data() +
+                                                sizeof(IndexCacheHeader)),
+      Hdr->NumSymbols);
+  for (const IndexCacheEntry &E : Entries)
+    if (uint64_t(E.NameOffset) + E.NameSize > StrTab.size() ||
+        E.MemberOffset >= MB.getBufferSize())
+      return false;
+
+  LazySymbols.reserve(Entries.size());
+  for (const IndexCacheEntry &E : Entries)
+    LazySymbols.emplace_back(this, StrTab.substr(E.NameOffset, E.NameSize),
+                             E.NameHash, E.MemberOffset);
+  IndexCache = std::move(*MBOrErr);
+  return true;
+}
+
+// Writes the symbols of this archive to a given cache file. The cache is
+// only an optimization, so errors are ignored.
+void ArchiveFile::writeIndexCache(StringRef Path, uint64_t Size,
+                                  uint64_t MTime) {
+  std::vector<IndexCacheEntry> Entries;
+  std::string StrTab;
+  for (const Archive::Symbol &Sym : File->symbols()) {
+    ErrorOr<Archive::Child> COrErr = Sym.getMember();
+    if (!COrErr)
+      return;
+    StringRef Name = Sym.getName();
+    IndexCacheEntry E;
+    E.MemberOffset = COrErr->getChildOffset();
+    E.NameOffset = StrTab.size();
+    E.NameSize = Name.size();
+    E.NameHash = hashGnu(Name);
+    E.Padding = 0;
+    Entries.push_back(E);
+    StrTab += Name;
+  }
+
+  IndexCacheHeader Hdr;
+  memcpy(Hdr.Magic, IndexCacheMagic, sizeof(Hdr.Magic));
+  Hdr.ArchiveSize = Size;
+  Hdr.ArchiveMTime = MTime;
+  Hdr.NumSymbols = Entries.size();
+  Hdr.StrTabSize = StrTab.size();
+  Hdr.Checksum = getIndexCacheChecksum(
+      StringRef(reinterpret_cast<const char *>(Entries.data()),
+                Entries.size() * sizeof(IndexCacheEntry)),
+      StrTab);
+
+  // Write to a temporary file and rename it, so that concurrent links
+  // never see a partially written cache file.
+  create_directories(Config->ArchiveIndexCache);
+  SmallString<128> TempPath;
+  int FD;
+  if (createUniqueFile(Path + ".tmp%%%%%%", FD, TempPath))
+    return;
+  raw_fd_ostream OS(FD, /*shouldClose=*/true);
+  OS.write(reinterpret_cast<const char *>(&Hdr), sizeof(Hdr));
+  OS.write(reinterpret_cast<const char *>(Entries.data()),
+           Entries.size() * sizeof(IndexCacheEntry));
+  OS << StrTab;
+  OS.close();
+  if (OS.has_error()) {
+    OS.clear_error();
+    sys::fs::remove(TempPath);
+    return;
+  }
+  if (sys::fs::rename(TempPath, Path))
+    sys::fs::remove(TempPath);
 }
 
 // Returns a buffer pointing to a member file containing a given symbol.
@@ -354,13 +592,94 @@ MemoryBufferRef ArchiveFile::getMember(const Archive::Symbol *Sym) {
   Archive::Child C =
       check(Sym->getMember(),
             "could not get the member for symbol " + Sym->getName());
+  return getMemberBuffer(C, Sym->getName());
+}
 
+// Same as above, but for a symbol whose member offset was read from the
+// archive index cache. The offset is validated only here, so that using
+// a cache does not read every member header. If the archive was rewritten
+// without changing its size or modification time, the offset may not
+// point to a member, in which case the archive symbol table is used.
+MemoryBufferRef ArchiveFile::getMemberAt(uint64_t Offset, StringRef SymName) {
+  if (Offset + sizeof(ArchiveMemberHeader) <= MB.getBufferSize()) {
+    std::error_code EC;
+    Archive::Child C(File.get(), MB.getBufferStart() + Offset, &EC);
+    if (!EC)
+      return getMemberBuffer(C, SymName);
+  }
+  for (const Archive::Symbol &Sym : File->symbols())
+    if (Sym.getName() == SymName)
+      return getMember(&Sym);
+  fatal("could not get the member for symbol " + SymName);
+}
+
+// Returns a buffer for member C, which defines SymName, or an empty
+// buffer if it has already been returned. Members of a thin archive are
+// separate files, which are mapped into memory here.
+MemoryBufferRef ArchiveFile::getMemberBuffer(const Archive::Child &C,
+                                             StringRef SymName) {
   if (!Seen.insert(C.getChildOffset()).second)
     return MemoryBufferRef();
-
   return check(C.getMemoryBufferRef(),
                "could not get the buffer for the member defining symbol " +
-                   Sym->getName());
+                   SymName);
+}
+
+// Reads the ELF class, the byte order and the machine type from the ELF
+// header, so that they are known without knowing ELFT.
+LazyObjectFile::LazyObjectFile(MemoryBufferRef M)
+    : InputFile(LazyObjectKind, M) {
+  std::pair<unsigned char, unsigned char> Type = getElfArchType(M.getBuffer());
+  if (Type.second != ELF::ELFDATA2LSB && Type.second != ELF::ELFDATA2MSB)
+    fatal("invalid data encoding: " + M.getBufferIdentifier());
+  if (Type.first != ELF::ELFCLASS32 && Type.first != ELF::ELFCLASS64)
+    fatal("invalid file class: " + M.getBufferIdentifier());
+  if (M.getBufferSize() < sizeof(ELF32LE::Ehdr))
+    fatal("file is too short: " + M.getBufferIdentifier());
+
+  // e_machine is at the same offset in 32-bit and 64-bit headers.
+  bool Is64 = Type.first == ELF::ELFCLASS64;
+  const char *Machine =
+      M.getBufferStart() + offsetof(ELF32LE::Ehdr, e_machine);
+  if (Type.second == ELF::ELFDATA2LSB) {
+    EKind = Is64 ? ELF64LEKind : ELF32LEKind;
+    EMachine = support::endian::read16le(Machine);
+  } else {
+    EKind = Is64 ? ELF64BEKind : ELF32BEKind;
+    EMachine = support::endian::read16be(Machine);
+  }
+}
+
+// Creates Lazy symbols for the symbols defined by this file.
+template <class ELFT> void LazyObjectFile::parse() {
+  typedef typename ELFT::Shdr Elf_Shdr;
+  typedef typename ELFT::Sym Elf_Sym;
+
+  ELFFile<ELFT> Obj = createELFObj<ELFT>(MB);
+  for (const Elf_Shdr &Sec : Obj.sections()) {
+    if (Sec.sh_type != SHT_SYMTAB)
+      continue;
+    StringRef StringTable = check(Obj.getStringTableForSymtab(Sec));
+    typename ELFT::SymRange Syms = Obj.symbols(&Sec);
+    uint32_t NumSymbols = std::distance(Syms.begin(), Syms.end());
+    uint32_t FirstNonLocal = Sec.sh_info;
+    if (FirstNonLocal > NumSymbols)
+      fatal("invalid sh_info in symbol table");
+
+    LazySymbols.reserve(NumSymbols - FirstNonLocal);
+    for (const Elf_Sym &Sym : make_range(Syms.begin() + FirstNonLocal,
+                                         Syms.end()))
+      if (Sym.st_shndx != SHN_UNDEF)
+        LazySymbols.emplace_back(this, check(Sym.getName(StringTable)));
+    return;
+  }
+}
+
+MemoryBufferRef LazyObjectFile::getBuffer() {
+  if (Seen)
+    return MemoryBufferRef();
+  Seen = true;
+  return MB;
 }
 
 template <class ELFT>
@@ -382,6 +701,8 @@ template <class ELFT> void SharedFile<ELFT>::parseSoName() {
   typedef typename ELFT::Dyn Elf_Dyn;
   typedef typename ELFT::uint uintX_t;
   const Elf_Shdr *DynamicSec = nullptr;
+  const Elf_Shdr *GnuHashSec = nullptr;
+  const Elf_Shdr *SysvHashSec = nullptr;
 
   const ELFFile<ELFT> Obj = this->ELFObj;
   for (const Elf_Shdr &Sec : Obj.sections()) {
@@ -394,6 +715,12 @@ template <class ELFT> void SharedFile<ELFT>::parseSoName() {
     case SHT_DYNAMIC:
       DynamicSec = &Sec;
       break;
+    case SHT_GNU_HASH:
+      GnuHashSec = &Sec;
+      break;
+    case SHT_HASH:
+      SysvHashSec = &Sec;
+      break;
     case SHT_SYMTAB_SHNDX:
       this->SymtabSHNDX = check(Obj.getSHNDXTable(Sec));
       break;
@@ -402,6 +729,8 @@ template <class ELFT> void SharedFile<ELFT>::parseSoName() {
 
   this->initStringTable();
   SoName = this->getName();
+  if (Config->LazySharedSymbols)
+    initHashTable(GnuHashSec ? GnuHashSec : SysvHashSec);
 
   if (!DynamicSec)
     return;
@@ -420,20 +749,129 @@ template <class ELFT> void SharedFile<ELFT>::parseSoName() {
   }
 }
 
+// Reads the header of the hash table of the dynamic symbol table.
+// Sec is either a .gnu.hash or a .hash section.
+template <class ELFT>
+void SharedFile<ELFT>::initHashTable(const Elf_Shdr *Sec) {
+  const ELFFile<ELFT> &Obj = this->ELFObj;
+  if (!Sec || !this->Symtab)
+    return;
+  if (check(Obj.getSection(Sec->sh_link)) != this->Symtab)
+    return;
+
+  Elf_Sym_Range Syms = this->getElfSymbols(false);
+  DynSyms = makeArrayRef(Syms.begin(), Syms.end());
+  ArrayRef<uint8_t> Data = check(Obj.getSectionContents(Sec));
+  auto *Words = reinterpret_cast<const Elf_Word *>(Data.data());
+  uint64_t NumWords = Data.size() / sizeof(Elf_Word);
+
+  if (Sec->sh_type == SHT_HASH) {
+    // nbucket, nchain, buckets and chains.
+    if (NumWords < 2 || NumWords - 2 < uint64_t(Words[0]) + Words[1])
+      fatal("invalid .hash section");
+    Buckets = makeArrayRef(Words + 2, Words[0]);
+    Chains = makeArrayRef(Words + 2 + Words[0], Words[1]);
+    HashSec = Sec;
+    return;
+  }
+
+  // nbuckets, symndx, maskwords, shift2, bloom filter, buckets and
+  // hash values of symbols starting from symndx.
+  if (NumWords < 4)
+    fatal("invalid .gnu.hash section");
+  uint64_t BloomWords = Words[2] * (sizeof(Elf_Off) / sizeof(Elf_Word));
+  if (Words[1] > DynSyms.size() || NumWords - 4 < BloomWords + Words[0])
+    fatal("invalid .gnu.hash section");
+  FirstHashed = Words[1];
+  BloomShift = Words[3];
+  Bloom = makeArrayRef(reinterpret_cast<const Elf_Off *>(Words + 4), Words[2]);
+  Buckets = makeArrayRef(Words + 4 + BloomWords, Words[0]);
+  Chains = makeArrayRef(Buckets.end(), Words + NumWords);
+  HashSec = Sec;
+}
+
+// Returns true if the dynamic symbol at Index is a global symbol
+// named Name that is defined by this file.
+template <class ELFT>
+bool SharedFile<ELFT>::isDefinedAs(uint32_t Index, StringRef Name) {
+  if (Index >= DynSyms.size() || Index < this->Symtab->sh_info)
+    return false;
+  const Elf_Sym &Sym = DynSyms[Index];
+  return !Sym.isUndefined() && check(Sym.getName(this->StringTable)) == Name;
+}
+
+template <class ELFT>
+std::vector<SharedSymbol<ELFT> *>
+SharedFile<ELFT>::findSymbols(StringRef Name, uint32_t Hash) {
+  std::vector<uint32_t> Indices;
+  if (HashSec->sh_type == SHT_GNU_HASH) {
+    // Symbols with the same hash value are adjacent in the symbol
+    // table, so this finds them in the symbol table order.
+    if (Bloom.empty() || Buckets.empty())
+      return {};
+    const unsigned C = sizeof(Elf_Off) * 8;
+    uint64_t Word = Bloom[(Hash / C) % Bloom.size()];
+    uint64_t Mask = (uint64_t(1) << (Hash % C)) |
+                    (uint64_t(1) << ((Hash >> BloomShift) % C));
+    if ((Word & Mask) != Mask)
+      return {};
+    uint32_t I = Buckets[Hash % Buckets.size()];
+    if (I == 0)
+      return {};
+    for (; I >= FirstHashed && I - FirstHashed < Chains.size(); ++I) {
+      uint32_t H = Chains[I - FirstHashed];
+      if ((H | 1) == (Hash | 1) && isDefinedAs(I, Name))
+        Indices.push_back(I);
+      if (H & 1)
+        break;
+    }
+  } else {
+    // Chains are not sorted, and they may be broken in a malformed file,
+    // so we follow at most as many links as there are symbols.
+    if (Buckets.empty())
+      return {};
+    uint32_t I = Buckets[hashSysv(Name) % Buckets.size()];
+    for (size_t N = 0; I != 0 && I < Chains.size() && N < Chains.size(); ++N) {
+      if (isDefinedAs(I, Name))
+        Indices.push_back(I);
+      I = Chains[I];
+    }
+    std::sort(Indices.begin(), Indices.end());
+  }
+
+  std::vector<SharedSymbol<ELFT> *> V;
+  for (uint32_t I : Indices) {
+    const Elf_Sym &Sym = DynSyms[I];
+    StringRef S = check(Sym.getName(this->StringTable));
+    V.push_back(new (SymAlloc.Allocate()) SharedSymbol<ELFT>(this, S, Sym));
+  }
+  return V;
+}
+
 // Fully parse the shared object file. This must be called after parseSoName().
+// If symbols are looked up on demand, this only collects undefined symbols.
 template <class ELFT> void SharedFile<ELFT>::parseRest() {
   Elf_Sym_Range Syms = this->getElfSymbols(true);
-  uint32_t NumSymbols = std::distance(Syms.begin(), Syms.end());
-  SymbolBodies.reserve(NumSymbols);
+  if (!isLazy())
+    SymbolBodies.reserve(std::distance(Syms.begin(), Syms.end()));
   for (const Elf_Sym &Sym : Syms) {
-    StringRef Name = check(Sym.getName(this->StringTable));
     if (Sym.isUndefined())
-      Undefs.push_back(Name);
-    else
-      SymbolBodies.emplace_back(this, Name, Sym);
+      Undefs.push_back(check(Sym.getName(this->StringTable)));
+    else if (!isLazy())
+      SymbolBodies.emplace_back(
+          this, check(Sym.getName(this->StringTable)), Sym);
   }
 }
 
+// Fully parse the shared object file. Unlike parseSoName() followed by
+// parseRest(), this function can be called for multiple files in parallel
+// before knowing whether the file is a duplicate or not.
+template <class ELFT> void SharedFile<ELFT>::preparse() {
+  parseSoName();
+  parseRest();
+  Preparsed = true;
+}
+
 BitcodeFile::BitcodeFile(MemoryBufferRef M) : InputFile(BitcodeKind, M) {}
 
 bool BitcodeFile::classof(const InputFile *F) {
@@ -559,10 +997,30 @@ std::unique_ptr<InputFile> elf::createObjectFile(MemoryBufferRef MB,
   return F;
 }
 
+std::string elf::getArchiveMemberPath(const Archive &Parent, StringRef Name) {
+  if (sys::path::is_absolute(Name))
+    return Name;
+  SmallString<128> Path = sys::path::parent_path(Parent.getFileName());
+  sys::path::append(Path, Name);
+  return Path.str();
+}
+
 std::unique_ptr<InputFile> elf::createSharedFile(MemoryBufferRef MB) {
   return createELFFile<SharedFile>(MB);
 }
 
+std::unique_ptr<InputFile> elf::createLazyObjectFile(MemoryBufferRef MB) {
+  auto F = make_unique<LazyObjectFile>(MB);
+
+  // Lazy object files determine the target like other ELF files do,
+  // but they never become Config->FirstElf.
+  if (Config->EKind == ELFNoneKind) {
+    Config->EKind = F->getELFKind();
+    Config->EMachine = F->getEMachine();
+  }
+  return std::move(F);
+}
+
 template class elf::ELFFileBase<ELF32LE>;
 template class elf::ELFFileBase<ELF32BE>;
 template class elf::ELFFileBase<ELF64LE>;
@@ -577,3 +1035,8 @@ template class elf::SharedFile<ELF32LE>;
 template class elf::SharedFile<ELF32BE>;
 template class elf::SharedFile<ELF64LE>;
 template class elf::SharedFile<ELF64BE>;
+
+template void LazyObjectFile::parse<ELF32LE>();
+template void LazyObjectFile::parse<ELF32BE>();
+template void LazyObjectFile::parse<ELF64LE>();
+template void LazyObjectFile::parse<ELF64BE>();
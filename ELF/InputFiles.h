@@ -36,7 +36,13 @@ class SymbolBody;
 // The root class of input files.
 class InputFile {
 public:
-  enum Kind { ObjectKind, SharedKind, ArchiveKind, BitcodeKind };
+  enum Kind {
+    ObjectKind,
+    SharedKind,
+    ArchiveKind,
+    LazyObjectKind,
+    BitcodeKind
+  };
   Kind kind() const { return FileKind; }
 
   StringRef getName() const { return MB.getBufferIdentifier(); }
@@ -111,7 +117,9 @@ public:
   ArrayRef<SymbolBody *> getNonLocalSymbols();
 
   explicit ObjectFile(MemoryBufferRef M);
+  void preparse();
   void parse(llvm::DenseSet<StringRef> &ComdatGroups);
+  void parseSections();
 
   ArrayRef<InputSectionBase<ELFT> *> getSections() const { return Sections; }
   InputSectionBase<ELFT> *getSection(const Elf_Sym &Sym) const;
@@ -132,8 +140,10 @@ public:
   std::vector<std::pair<const Elf_Sym *, unsigned>> KeptLocalSyms;
 
 private:
-  void initializeSections(llvm::DenseSet<StringRef> &ComdatGroups);
+  void initializeSections();
   void initializeSymbols();
+  void discardComdatGroups(llvm::DenseSet<StringRef> &ComdatGroups);
+  void initializeRelocSection(const Elf_Shdr &Sec);
   InputSectionBase<ELFT> *getRelocTarget(const Elf_Shdr &Sec);
   InputSectionBase<ELFT> *createInputSection(const Elf_Shdr &Sec);
 
@@ -145,9 +155,18 @@ private:
   // List of all symbols referenced or defined by this file.
   std::vector<SymbolBody *> SymbolBodies;
 
+  // SHT_GROUP sections and their signatures. Whether a group is kept or
+  // not depends on the order of files, so it is decided in parse().
+  std::vector<std::pair<StringRef, const Elf_Shdr *>> ComdatGroupSections;
+
   // MIPS .reginfo section defined by this file.
   MipsReginfoInputSection<ELFT> *MipsReginfo = nullptr;
 
+  // .note.GNU-split-stack section defined by this file.
+  const Elf_Shdr *SplitStackSec = nullptr;
+
+  bool Preparsed = false;
+
   llvm::BumpPtrAllocator Alloc;
   llvm::SpecificBumpPtrAllocator<MergeInputSection<ELFT>> MAlloc;
   llvm::SpecificBumpPtrAllocator<EHInputSection<ELFT>> EHAlloc;
@@ -164,14 +183,48 @@ public:
   // (So that we don't instantiate same members more than once.)
   MemoryBufferRef getMember(const Archive::Symbol *Sym);
 
+  // Same as getMember, but for a symbol read from the archive index cache.
+  MemoryBufferRef getMemberAt(uint64_t Offset, StringRef SymName);
+
   llvm::MutableArrayRef<Lazy> getLazySymbols() { return LazySymbols; }
 
 private:
+  bool readIndexCache(StringRef Path, uint64_t Size, uint64_t MTime);
+  void writeIndexCache(StringRef Path, uint64_t Size, uint64_t MTime);
+  MemoryBufferRef getMemberBuffer(const Archive::Child &C, StringRef SymName);
+
   std::unique_ptr<Archive> File;
+  std::unique_ptr<MemoryBuffer> IndexCache;
   std::vector<Lazy> LazySymbols;
   llvm::DenseSet<uint64_t> Seen;
 };
 
+// An object file between --start-lib and --end-lib. Like an archive
+// member, it is added to the link only if it defines a symbol that is
+// needed by other files. Until then, only its symbol table is read.
+class LazyObjectFile : public InputFile {
+public:
+  explicit LazyObjectFile(MemoryBufferRef M);
+  static bool classof(const InputFile *F) {
+    return F->kind() == LazyObjectKind;
+  }
+  template <class ELFT> void parse();
+
+  // Returns the contents of this file, or an empty buffer if they have
+  // already been returned.
+  MemoryBufferRef getBuffer();
+
+  llvm::MutableArrayRef<Lazy> getLazySymbols() { return LazySymbols; }
+  ELFKind getELFKind() const { return EKind; }
+  uint16_t getEMachine() const { return EMachine; }
+
+private:
+  std::vector<Lazy> LazySymbols;
+  ELFKind EKind;
+  uint16_t EMachine;
+  bool Seen = false;
+};
+
 class BitcodeFile : public InputFile {
 public:
   explicit BitcodeFile(MemoryBufferRef M);
@@ -197,11 +250,27 @@ template <class ELFT> class SharedFile : public ELFFileBase<ELFT> {
   typedef typename ELFT::Sym Elf_Sym;
   typedef typename ELFT::Word Elf_Word;
   typedef typename ELFT::SymRange Elf_Sym_Range;
+  typedef typename ELFT::Off Elf_Off;
 
   std::vector<SharedSymbol<ELFT>> SymbolBodies;
   std::vector<StringRef> Undefs;
   StringRef SoName;
 
+  // The .gnu.hash or .hash section of the dynamic symbol table. If
+  // --lazy-shared-symbols is given and the file has one, symbols are
+  // not added to the symbol table up front but looked up on demand.
+  const Elf_Shdr *HashSec = nullptr;
+  ArrayRef<Elf_Sym> DynSyms;
+  ArrayRef<Elf_Off> Bloom;
+  ArrayRef<Elf_Word> Buckets;
+  ArrayRef<Elf_Word> Chains;
+  uint32_t FirstHashed = 0;
+  uint32_t BloomShift = 0;
+  llvm::SpecificBumpPtrAllocator<SharedSymbol<ELFT>> SymAlloc;
+
+  void initHashTable(const Elf_Shdr *Sec);
+  bool isDefinedAs(uint32_t Index, StringRef Name);
+
 public:
   StringRef getSoName() const { return SoName; }
   llvm::MutableArrayRef<SharedSymbol<ELFT>> getSharedSymbols() {
@@ -210,6 +279,13 @@ public:
   const Elf_Shdr *getSection(const Elf_Sym &Sym) const;
   llvm::ArrayRef<StringRef> getUndefinedSymbols() { return Undefs; }
 
+  // Returns true if symbols are looked up on demand by findSymbols().
+  bool isLazy() const { return HashSec != nullptr; }
+
+  // Returns new SharedSymbols for the defined global symbols named Name
+  // in the symbol table order. Hash is the GNU hash value of Name.
+  std::vector<SharedSymbol<ELFT> *> findSymbols(StringRef Name, uint32_t Hash);
+
   static bool classof(const InputFile *F) {
     return F->kind() == Base::SharedKind;
   }
@@ -218,6 +294,10 @@ public:
 
   void parseSoName();
   void parseRest();
+  void preparse();
+
+  // True if parseSoName() and parseRest() have already been called.
+  bool Preparsed = false;
 
   // Used for --as-needed
   bool AsNeeded = false;
@@ -228,6 +308,14 @@ public:
 std::unique_ptr<InputFile> createObjectFile(MemoryBufferRef MB,
                                             StringRef ArchiveName = "");
 std::unique_ptr<InputFile> createSharedFile(MemoryBufferRef MB);
+std::unique_ptr<InputFile> createLazyObjectFile(MemoryBufferRef MB);
+
+// Returns the path of archive member Name, relative to the directory of
+// archive Parent unless Name is absolute. Members of a thin archive are
+// looked up this way, so nested archives have to be given this path as
+// their buffer identifier.
+std::string getArchiveMemberPath(const llvm::object::Archive &Parent,
+                                 StringRef Name);
 
 } // namespace elf
 } // namespace lld
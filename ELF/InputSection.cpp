@@ -15,6 +15,7 @@
 #include "Target.h"
 
 #include "llvm/Support/Endian.h"
+#include "llvm/Support/MathExtras.h"
 
 using namespace llvm;
 using namespace llvm::ELF;
@@ -69,25 +70,67 @@ typename ELFT::uint InputSectionBase<ELFT>::getOffset(const Elf_Sym &Sym) {
   return getOffset(Sym.st_value);
 }
 
+template <class ELFT> void InputSectionBase<ELFT>::initRelocations() {
+  if (Header->sh_flags & SHF_ALLOC)
+    decodeRelocations(Relocations);
+}
+
+template <class ELFT>
+ArrayRef<Relocation<ELFT>>
+InputSectionBase<ELFT>::getRelocations(std::vector<Relocation<ELFT>> &Buf) {
+  if (Header->sh_flags & SHF_ALLOC)
+    return Relocations;
+  Buf.clear();
+  decodeRelocations(Buf);
+  return Buf;
+}
+
+template <class ELFT>
+void InputSectionBase<ELFT>::decodeRelocations(
+    std::vector<Relocation<ELFT>> &V) {
+  ELFFile<ELFT> &Obj = File->getObj();
+  auto Add = [&](const Elf_Shdr *RelSec) {
+    if (RelSec->sh_type == SHT_RELA)
+      addRelocations(Obj.relas(RelSec), V);
+    else
+      addRelocations(Obj.rels(RelSec), V);
+  };
+  if (auto *S = dyn_cast<InputSection<ELFT>>(this)) {
+    for (const Elf_Shdr *RelSec : S->RelocSections)
+      Add(RelSec);
+  } else if (auto *S = dyn_cast<EHInputSection<ELFT>>(this)) {
+    if (S->RelocSection)
+      Add(S->RelocSection);
+  }
+}
+
+template <class ELFT>
+template <class RelTy>
+void InputSectionBase<ELFT>::addRelocations(
+    iterator_range<const RelTy *> Rels, std::vector<Relocation<ELFT>> &V) {
+  AreRelocsRela = RelTy::IsRela;
+  V.reserve(V.size() + (Rels.end() - Rels.begin()));
+  for (const RelTy &RI : Rels) {
+    if (uint64_t(RI.r_offset) > UINT32_MAX)
+      fatal("relocation offset is too large: " + getSectionName());
+    uint32_t SymIndex = RI.getSymbol(Config->Mips64EL);
+    V.push_back({uint32_t(RI.r_offset), RI.getType(Config->Mips64EL),
+                 getAddend<ELFT>(RI), &File->getSymbolBody(SymIndex)});
+  }
+}
+
 // Returns a section that Rel relocation is pointing to.
 template <class ELFT>
 InputSectionBase<ELFT> *
-InputSectionBase<ELFT>::getRelocTarget(const Elf_Rel &Rel) const {
+InputSectionBase<ELFT>::getRelocTarget(const Relocation<ELFT> &Rel) const {
   // Global symbol
-  uint32_t SymIndex = Rel.getSymbol(Config->Mips64EL);
-  SymbolBody &B = File->getSymbolBody(SymIndex).repl();
+  SymbolBody &B = Rel.Sym->repl();
   if (auto *D = dyn_cast<DefinedRegular<ELFT>>(&B))
     if (D->Section)
       return D->Section->Repl;
   return nullptr;
 }
 
-template <class ELFT>
-InputSectionBase<ELFT> *
-InputSectionBase<ELFT>::getRelocTarget(const Elf_Rela &Rel) const {
-  return getRelocTarget(reinterpret_cast<const Elf_Rel &>(Rel));
-}
-
 template <class ELFT>
 InputSection<ELFT>::InputSection(elf::ObjectFile<ELFT> *F,
                                  const Elf_Shdr *Header)
@@ -127,183 +170,10 @@ void InputSection<ELFT>::copyRelocations(uint8_t *Buf,
   }
 }
 
-template <class RelTy>
-static uint32_t getMipsPairType(const RelTy *Rel, const SymbolBody &Sym) {
-  switch (Rel->getType(Config->Mips64EL)) {
-  case R_MIPS_HI16:
-    return R_MIPS_LO16;
-  case R_MIPS_GOT16:
-    return Sym.isLocal() ? R_MIPS_LO16 : R_MIPS_NONE;
-  case R_MIPS_PCHI16:
-    return R_MIPS_PCLO16;
-  case R_MICROMIPS_HI16:
-    return R_MICROMIPS_LO16;
-  default:
-    return R_MIPS_NONE;
-  }
-}
-
-template <endianness E> static int16_t readSignedLo16(uint8_t *Loc) {
-  return read32<E>(Loc) & 0xffff;
-}
-
-template <class ELFT>
-template <class RelTy>
-int32_t
-InputSectionBase<ELFT>::findMipsPairedAddend(uint8_t *Buf, uint8_t *BufLoc,
-                                             SymbolBody &Sym, const RelTy *Rel,
-                                             const RelTy *End) {
-  uint32_t SymIndex = Rel->getSymbol(Config->Mips64EL);
-  uint32_t Type = getMipsPairType(Rel, Sym);
-
-  // Some MIPS relocations use addend calculated from addend of the relocation
-  // itself and addend of paired relocation. ABI requires to compute such
-  // combined addend in case of REL relocation record format only.
-  // See p. 4-17 at ftp://www.linux-mips.org/pub/linux/mips/doc/ABI/mipsabi.pdf
-  if (RelTy::IsRela || Type == R_MIPS_NONE)
-    return 0;
-
-  for (const RelTy *RI = Rel; RI != End; ++RI) {
-    if (RI->getType(Config->Mips64EL) != Type)
-      continue;
-    if (RI->getSymbol(Config->Mips64EL) != SymIndex)
-      continue;
-    uintX_t Offset = getOffset(RI->r_offset);
-    if (Offset == (uintX_t)-1)
-      break;
-    const endianness E = ELFT::TargetEndianness;
-    return ((read32<E>(BufLoc) & 0xffff) << 16) +
-           readSignedLo16<E>(Buf + Offset);
-  }
-  unsigned OldType = Rel->getType(Config->Mips64EL);
-  StringRef OldName = getELFRelocationTypeName(Config->EMachine, OldType);
-  StringRef NewName = getELFRelocationTypeName(Config->EMachine, Type);
-  warning("can't find matching " + NewName + " relocation for " + OldName);
-  return 0;
-}
-
-template <class ELFT, class uintX_t>
-static uintX_t adjustMipsSymVA(uint32_t Type, const elf::ObjectFile<ELFT> &File,
-                               const SymbolBody &Body, uintX_t AddrLoc,
-                               uintX_t SymVA) {
-  if (Type == R_MIPS_HI16 && &Body == Config->MipsGpDisp)
-    return getMipsGpAddr<ELFT>() - AddrLoc;
-  if (Type == R_MIPS_LO16 && &Body == Config->MipsGpDisp)
-    return getMipsGpAddr<ELFT>() - AddrLoc + 4;
-  if (&Body == Config->MipsLocalGp)
-    return getMipsGpAddr<ELFT>();
-  if (Body.isLocal() && (Type == R_MIPS_GPREL16 || Type == R_MIPS_GPREL32))
-    // We need to adjust SymVA value in case of R_MIPS_GPREL16/32
-    // relocations because they use the following expression to calculate
-    // the relocation's result for local symbol: S + A + GP0 - G.
-    return SymVA + File.getMipsGp0();
-  return SymVA;
-}
-
-template <class ELFT, class uintX_t>
-static uintX_t getMipsGotVA(const SymbolBody &Body, uintX_t SymVA,
-                            uint8_t *BufLoc) {
-  if (Body.isLocal())
-    // If relocation against MIPS local symbol requires GOT entry, this entry
-    // should be initialized by 'page address'. This address is high 16-bits
-    // of sum the symbol's value and the addend.
-    return Out<ELFT>::Got->getMipsLocalPageAddr(SymVA);
-  if (!Body.isPreemptible())
-    // For non-local symbols GOT entries should contain their full
-    // addresses. But if such symbol cannot be preempted, we do not
-    // have to put them into the "global" part of GOT and use dynamic
-    // linker to determine their actual addresses. That is why we
-    // create GOT entries for them in the "local" part of GOT.
-    return Out<ELFT>::Got->getMipsLocalFullAddr(Body);
-  return Body.getGotVA<ELFT>();
-}
-
 template <class ELFT>
-template <class RelTy>
-void InputSectionBase<ELFT>::relocate(uint8_t *Buf, uint8_t *BufEnd,
-                                      iterator_range<const RelTy *> Rels) {
-  size_t Num = Rels.end() - Rels.begin();
-  for (size_t I = 0; I < Num; ++I) {
-    const RelTy &RI = *(Rels.begin() + I);
-    uintX_t Offset = getOffset(RI.r_offset);
-    if (Offset == (uintX_t)-1)
-      continue;
-
-    uintX_t A = getAddend<ELFT>(RI);
-    uint32_t SymIndex = RI.getSymbol(Config->Mips64EL);
-    uint32_t Type = RI.getType(Config->Mips64EL);
-    uint8_t *BufLoc = Buf + Offset;
-    uintX_t AddrLoc = OutSec->getVA() + Offset;
-
-    if (Target->pointsToLocalDynamicGotEntry(Type) &&
-        !Target->canRelaxTls(Type, nullptr)) {
-      Target->relocateOne(BufLoc, BufEnd, Type, AddrLoc,
-                          Out<ELFT>::Got->getTlsIndexVA() + A);
-      continue;
-    }
-
-    SymbolBody &Body = File->getSymbolBody(SymIndex).repl();
-
-    if (Target->canRelaxTls(Type, &Body)) {
-      uintX_t SymVA;
-      if (Target->needsGot(Type, Body))
-        SymVA = Body.getGotVA<ELFT>();
-      else
-        SymVA = Body.getVA<ELFT>();
-      // By optimizing TLS relocations, it is sometimes needed to skip
-      // relocations that immediately follow TLS relocations. This function
-      // knows how many slots we need to skip.
-      I += Target->relaxTls(BufLoc, BufEnd, Type, AddrLoc, SymVA, Body);
-      continue;
-    }
-
-    // PPC64 has a special relocation representing the TOC base pointer
-    // that does not have a corresponding symbol.
-    if (Config->EMachine == EM_PPC64 && RI.getType(false) == R_PPC64_TOC) {
-      uintX_t SymVA = getPPC64TocBase() + A;
-      Target->relocateOne(BufLoc, BufEnd, Type, AddrLoc, SymVA);
-      continue;
-    }
-
-    if (Target->isTlsGlobalDynamicRel(Type) &&
-        !Target->canRelaxTls(Type, &Body)) {
-      Target->relocateOne(BufLoc, BufEnd, Type, AddrLoc,
-                          Out<ELFT>::Got->getGlobalDynAddr(Body) + A);
-      continue;
-    }
-
-    if (!RelTy::IsRela)
-      A += Target->getImplicitAddend(BufLoc, Type);
-    if (Config->EMachine == EM_MIPS)
-      A += findMipsPairedAddend(Buf, BufLoc, Body, &RI, Rels.end());
-    uintX_t SymVA = Body.getVA<ELFT>(A);
-
-    if (Target->needsPlt(Type, Body)) {
-      SymVA = Body.getPltVA<ELFT>() + A;
-    } else if (Target->needsGot(Type, Body)) {
-      if (Config->EMachine == EM_MIPS)
-        SymVA = getMipsGotVA<ELFT>(Body, SymVA, BufLoc);
-      else
-        SymVA = Body.getGotVA<ELFT>() + A;
-      if (Body.IsTls)
-        Type = Target->getTlsGotRel(Type);
-    } else if (Target->isSizeRel(Type) && Body.isPreemptible()) {
-      // A SIZE relocation is supposed to set a symbol size, but if a symbol
-      // can be preempted, the size at runtime may be different than link time.
-      // If that's the case, we leave the field alone rather than filling it
-      // with a possibly incorrect value.
-      continue;
-    } else if (Config->EMachine == EM_MIPS) {
-      SymVA = adjustMipsSymVA<ELFT>(Type, *File, Body, AddrLoc, SymVA);
-    } else if (!Target->needsCopyRel<ELFT>(Type, Body) &&
-               Body.isPreemptible()) {
-      continue;
-    }
-    if (Target->isSizeRel(Type))
-      SymVA = Body.getSize<ELFT>() + A;
-
-    Target->relocateOne(BufLoc, BufEnd, Type, AddrLoc, SymVA);
-  }
+void InputSectionBase<ELFT>::relocate(uint8_t *Buf, uint8_t *BufEnd) {
+  std::vector<Relocation<ELFT>> NonAllocRels;
+  Target->relocate(*this, getRelocations(NonAllocRels), Buf, BufEnd);
 }
 
 template <class ELFT> void InputSection<ELFT>::writeTo(uint8_t *Buf) {
@@ -325,14 +195,8 @@ template <class ELFT> void InputSection<ELFT>::writeTo(uint8_t *Buf) {
   ArrayRef<uint8_t> Data = this->getSectionData();
   memcpy(Buf + OutSecOff, Data.data(), Data.size());
 
-  // Iterate over all relocation sections that apply to this section.
-  uint8_t *BufEnd = Buf + OutSecOff + Data.size();
-  for (const Elf_Shdr *RelSec : this->RelocSections) {
-    if (RelSec->sh_type == SHT_RELA)
-      this->relocate(Buf, BufEnd, EObj.relas(RelSec));
-    else
-      this->relocate(Buf, BufEnd, EObj.rels(RelSec));
-  }
+  // Apply relocations to this section.
+  this->relocate(Buf, Buf + OutSecOff + Data.size());
 }
 
 template <class ELFT>
@@ -370,12 +234,12 @@ typename ELFT::uint EHInputSection<ELFT>::getOffset(uintX_t Offset) {
   // identify the start of the output .eh_frame. Handle this special case.
   if (this->getSectionHdr()->sh_size == 0)
     return Offset;
-  std::pair<uintX_t, uintX_t> *I = this->getRangeAndSize(Offset).first;
-  uintX_t Base = I->second;
+  SectionPiece<ELFT> *I = this->getRangeAndSize(Offset).first;
+  uintX_t Base = I->OutputOff;
   if (Base == uintX_t(-1))
     return -1; // Not in the output
 
-  uintX_t Addend = Offset - I->first;
+  uintX_t Addend = Offset - I->InputOff;
   return Base + Addend;
 }
 
@@ -384,53 +248,137 @@ MergeInputSection<ELFT>::MergeInputSection(elf::ObjectFile<ELFT> *F,
                                            const Elf_Shdr *Header)
     : SplitInputSection<ELFT>(F, Header, InputSectionBase<ELFT>::Merge) {}
 
+// Returns the offset of the first null character of EntSize bytes in S,
+// or StringRef::npos if there is no such character.
+static size_t findNull(StringRef S, size_t EntSize) {
+  // Optimize the common case. StringRef::find is implemented with memchr.
+  if (EntSize == 1)
+    return S.find(0);
+
+  // Scan eight bytes at once. For N-byte characters, (X - Lo) & ~X & Hi
+  // is not zero if and only if a character in X is zero. Only if that's
+  // the case, we look for the exact location.
+  size_t I = 0;
+  if (EntSize == 2 || EntSize == 4) {
+    uint64_t Lo =
+        (EntSize == 2) ? 0x0001000100010001ULL : 0x0000000100000001ULL;
+    uint64_t Hi = Lo << (EntSize * 8 - 1);
+    for (size_t N = S.size(); I + 8 <= N; I += 8) {
+      uint64_t X;
+      memcpy(&X, S.data() + I, 8);
+      if ((X - Lo) & ~X & Hi)
+        break;
+    }
+  }
+
+  for (size_t N = S.size(); I != N; I += EntSize) {
+    const char *B = S.begin() + I;
+    if (std::all_of(B, B + EntSize, [](char C) { return C == 0; }))
+      return I;
+  }
+  return StringRef::npos;
+}
+
+static uint32_t hashPiece(StringRef S) { return hash_value(S); }
+
+// Splits this section into pieces and computes their hash values.
+// Each piece is hashed as soon as it is found, while it is still in cache.
+template <class ELFT> void MergeInputSection<ELFT>::splitIntoPieces() {
+  uintX_t EntSize = this->Header->sh_entsize;
+  if (this->Header->sh_flags & SHF_WRITE)
+    fatal("writable SHF_MERGE sections are not supported");
+  if (!EntSize || this->Header->sh_size % EntSize)
+    fatal("SHF_MERGE section size must be a multiple of sh_entsize");
+
+  ArrayRef<uint8_t> D = this->getSectionData();
+  StringRef Data((const char *)D.data(), D.size());
+
+  // If this is of type string, the contents are null-terminated strings.
+  if (this->Header->sh_flags & SHF_STRINGS) {
+    uintX_t Offset = 0;
+    while (!Data.empty()) {
+      size_t End = findNull(Data, EntSize);
+      if (End == StringRef::npos)
+        fatal("string is not null terminated");
+      uintX_t Size = End + EntSize;
+      this->Offsets.emplace_back(Offset, hashPiece(Data.substr(0, Size)));
+      Data = Data.substr(Size);
+      Offset += Size;
+    }
+    this->initOffsetMap();
+    return;
+  }
+
+  // If this is not of type string, every entry has the same size.
+  for (uintX_t I = 0, N = Data.size(); I != N; I += EntSize)
+    this->Offsets.emplace_back(I, hashPiece(Data.substr(I, EntSize)));
+  this->initOffsetMap();
+}
+
 template <class ELFT>
 bool MergeInputSection<ELFT>::classof(const InputSectionBase<ELFT> *S) {
   return S->SectionKind == InputSectionBase<ELFT>::Merge;
 }
 
+template <class ELFT> void SplitInputSection<ELFT>::initOffsetMap() {
+  uintX_t Size = this->getSize();
+  if (Offsets.empty() || Size == 0)
+    return;
+  uintX_t AvgSize = std::max<uintX_t>(Size / Offsets.size(), 1);
+  OffsetMapShift = Log2_64(AvgSize);
+  OffsetMap.resize(((Size - 1) >> OffsetMapShift) + 1);
+
+  size_t I = 0;
+  for (size_t Page = 0, E = OffsetMap.size(); Page != E; ++Page) {
+    uintX_t Off = uintX_t(Page) << OffsetMapShift;
+    while (I + 1 < Offsets.size() && Offsets[I + 1].InputOff <= Off)
+      ++I;
+    OffsetMap[Page] = I;
+  }
+}
+
 template <class ELFT>
-std::pair<std::pair<typename ELFT::uint, typename ELFT::uint> *,
-          typename ELFT::uint>
+std::pair<SectionPiece<ELFT> *, typename ELFT::uint>
 SplitInputSection<ELFT>::getRangeAndSize(uintX_t Offset) {
-  ArrayRef<uint8_t> D = this->getSectionData();
-  StringRef Data((const char *)D.data(), D.size());
-  uintX_t Size = Data.size();
+  uintX_t Size = this->getSize();
   if (Offset >= Size)
     fatal("entry is past the end of the section");
 
+  // Find the range of pieces that may contain the offset.
+  auto Begin = Offsets.begin();
+  auto End = Offsets.end();
+  if (!OffsetMap.empty()) {
+    size_t Page = Offset >> OffsetMapShift;
+    Begin = Offsets.begin() + OffsetMap[Page];
+    if (Page + 1 < OffsetMap.size())
+      End = Offsets.begin() + OffsetMap[Page + 1] + 1;
+  }
+
   // Find the element this offset points to.
   auto I = std::upper_bound(
-      Offsets.begin(), Offsets.end(), Offset,
-      [](const uintX_t &A, const std::pair<uintX_t, uintX_t> &B) {
-        return A < B.first;
+      Begin, End, Offset, [](const uintX_t &A, const SectionPiece<ELFT> &B) {
+        return A < B.InputOff;
       });
-  uintX_t End = I == Offsets.end() ? Data.size() : I->first;
+  uintX_t PieceEnd = I == Offsets.end() ? Size : I->InputOff;
   --I;
-  return std::make_pair(&*I, End);
+  return std::make_pair(&*I, PieceEnd);
 }
 
 template <class ELFT>
 typename ELFT::uint MergeInputSection<ELFT>::getOffset(uintX_t Offset) {
-  std::pair<std::pair<uintX_t, uintX_t> *, uintX_t> T =
-      this->getRangeAndSize(Offset);
-  std::pair<uintX_t, uintX_t> *I = T.first;
-  uintX_t End = T.second;
-  uintX_t Start = I->first;
-
-  // Compute the Addend and if the Base is cached, return.
-  uintX_t Addend = Offset - Start;
-  uintX_t &Base = I->second;
-  if (Base != uintX_t(-1))
-    return Base + Addend;
-
-  // Map the base to the offset in the output section and cache it.
+  // Output offsets of pieces are assigned by MergeOutputSection::finalize.
+  SectionPiece<ELFT> *I = this->getRangeAndSize(Offset).first;
+  uintX_t Addend = Offset - I->InputOff;
+  return I->OutputOff + Addend;
+}
+
+template <class ELFT>
+StringRef MergeInputSection<ELFT>::getPieceData(size_t I) const {
   ArrayRef<uint8_t> D = this->getSectionData();
-  StringRef Data((const char *)D.data(), D.size());
-  StringRef Entry = Data.substr(Start, End - Start);
-  Base =
-      static_cast<MergeOutputSection<ELFT> *>(this->OutSec)->getOffset(Entry);
-  return Base + Addend;
+  uintX_t Begin = this->Offsets[I].InputOff;
+  uintX_t End = (I + 1 == this->Offsets.size()) ? D.size()
+                                                : this->Offsets[I + 1].InputOff;
+  return StringRef((const char *)D.data() + Begin, End - Begin);
 }
 
 template <class ELFT>
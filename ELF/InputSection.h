@@ -15,6 +15,8 @@
 #include "llvm/ADT/TinyPtrVector.h"
 #include "llvm/Object/ELF.h"
 
+#include <atomic>
+
 namespace lld {
 namespace elf {
 
@@ -23,6 +25,25 @@ template <class ELFT> class ObjectFile;
 template <class ELFT> class OutputSection;
 template <class ELFT> class OutputSectionBase;
 
+// A relocation decoded from an Elf_Rel or Elf_Rela record. Relocations
+// are decoded once after all input files are read, and every later pass
+// (GC, ICF, relocation scanning and relocation processing) uses them
+// instead of reading the raw records again.
+//
+// The offset is 32 bits wide even for ELF64 so that it shares a word with
+// the type, which makes an entry 24 bytes, the size of an Elf64_Rela.
+// Input sections are never 4 GiB or larger in practice.
+template <class ELFT> struct Relocation {
+  typedef typename ELFT::uint uintX_t;
+  uint32_t Offset;
+  uint32_t Type;
+  // The explicit addend. Always zero for Elf_Rel.
+  uintX_t Addend;
+  // The symbol body in the file's symbol table. Use repl() to get the
+  // resolved symbol.
+  SymbolBody *Sym;
+};
+
 // This corresponds to a section of an input file.
 template <class ELFT> class InputSectionBase {
 protected:
@@ -45,8 +66,9 @@ public:
   OutputSectionBase<ELFT> *OutSec = nullptr;
   uint32_t Align;
 
-  // Used for garbage collection.
-  bool Live;
+  // Used for garbage collection. The mark phase of --gc-sections may set
+  // this bit from multiple threads.
+  std::atomic<bool> Live;
 
   // This pointer points to the "real" instance of this instance.
   // Usually Repl == this. However, if ICF merges two sections,
@@ -71,24 +93,56 @@ public:
 
   ArrayRef<uint8_t> getSectionData() const;
 
+  // Relocations that apply to this section. Only relocations of
+  // SHF_ALLOC sections are decoded in advance. Non-alloc sections such as
+  // .debug_info often have most of the relocations of an object file, and
+  // they are needed only when the section is written.
+  std::vector<Relocation<ELFT>> Relocations;
+
+  // True if Relocations were read from SHT_RELA sections.
+  bool AreRelocsRela = false;
+
+  // Decodes relocation sections that apply to this section into Relocations
+  // if this is an SHF_ALLOC section.
+  void initRelocations();
+
+  // Returns Relocations if they have been decoded. Otherwise, clears Buf,
+  // decodes relocations into it and returns it. In that case the result is
+  // valid only until Buf is used again, so Buf can be reused for a series
+  // of sections.
+  ArrayRef<Relocation<ELFT>> getRelocations(std::vector<Relocation<ELFT>> &Buf);
+
   // Returns a section that Rel is pointing to. Used by the garbage collector.
-  InputSectionBase<ELFT> *getRelocTarget(const Elf_Rel &Rel) const;
-  InputSectionBase<ELFT> *getRelocTarget(const Elf_Rela &Rel) const;
+  InputSectionBase<ELFT> *getRelocTarget(const Relocation<ELFT> &Rel) const;
 
-  template <class RelTy>
-  void relocate(uint8_t *Buf, uint8_t *BufEnd,
-                llvm::iterator_range<const RelTy *> Rels);
+  void relocate(uint8_t *Buf, uint8_t *BufEnd);
 
 private:
+  void decodeRelocations(std::vector<Relocation<ELFT>> &V);
   template <class RelTy>
-  int32_t findMipsPairedAddend(uint8_t *Buf, uint8_t *BufLoc, SymbolBody &Sym,
-                               const RelTy *Rel, const RelTy *End);
+  void addRelocations(llvm::iterator_range<const RelTy *> Rels,
+                      std::vector<Relocation<ELFT>> &V);
 };
 
 template <class ELFT>
 InputSectionBase<ELFT> *
     InputSectionBase<ELFT>::Discarded = (InputSectionBase<ELFT> *)-1ULL;
 
+// A piece of data of a SplitInputSection.
+template <class ELFT> struct SectionPiece {
+  typedef typename ELFT::uint uintX_t;
+  SectionPiece(uintX_t InputOff, uint32_t Hash = 0)
+      : InputOff(InputOff), Hash(Hash) {}
+
+  // The offsets in the input section and in the output section.
+  // The latter may be -1 if it is not assigned yet.
+  uintX_t InputOff;
+  uintX_t OutputOff = -1;
+
+  // The hash value of the contents. Used only for SHF_MERGE sections.
+  uint32_t Hash;
+};
+
 // Usually sections are copied to the output as atomic chunks of data,
 // but some special types of sections are split into small pieces of data
 // and each piece is copied to a different place in the output.
@@ -101,12 +155,22 @@ public:
   SplitInputSection(ObjectFile<ELFT> *File, const Elf_Shdr *Header,
                     typename InputSectionBase<ELFT>::Kind SectionKind);
 
-  // For each piece of data, we maintain the offsets in the input section and
-  // in the output section. The latter may be -1 if it is not assigned yet.
-  std::vector<std::pair<uintX_t, uintX_t>> Offsets;
+  // Pieces of data in the order they appear in the input section.
+  std::vector<SectionPiece<ELFT>> Offsets;
 
-  std::pair<std::pair<uintX_t, uintX_t> *, uintX_t>
-  getRangeAndSize(uintX_t Offset);
+  // Builds a table to look up pieces by input offsets.
+  // Must be called once all pieces are added to Offsets.
+  void initOffsetMap();
+
+  std::pair<SectionPiece<ELFT> *, uintX_t> getRangeAndSize(uintX_t Offset);
+
+private:
+  // OffsetMap[I] is the index of the piece that contains the byte at
+  // (I << OffsetMapShift). Pages are no larger than the average piece,
+  // so only a few pieces need to be examined for each lookup. The table
+  // is never modified after construction, so lookups are thread-safe.
+  std::vector<uint32_t> OffsetMap;
+  unsigned OffsetMapShift = 0;
 };
 
 // This corresponds to a SHF_MERGE section of an input file.
@@ -121,6 +185,13 @@ public:
   // Translate an offset in the input section to an offset in the output
   // section.
   uintX_t getOffset(uintX_t Offset);
+
+  // Returns the I-th piece of data.
+  StringRef getPieceData(size_t I) const;
+
+  // Splits this section into pieces. Called once the section is known
+  // not to be discarded.
+  void splitIntoPieces();
 };
 
 // This corresponds to a .eh_frame section of an input file.
@@ -174,8 +245,9 @@ private:
   // Called by ICF to merge two input sections.
   void replace(InputSection<ELFT> *Other);
 
-  // Used by ICF.
-  uint64_t GroupId = 0;
+  // Used by ICF. ICF reads equivalence class IDs from one slot and writes
+  // refined IDs to the other.
+  uint64_t GroupId[2] = {0, 0};
 };
 
 // MIPS .reginfo section provides information on the registers used by the code
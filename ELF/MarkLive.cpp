@@ -18,6 +18,12 @@
 // bits. Writer will then ignore sections whose Live bits are off, so that
 // such sections are not included into output.
 //
+// If threads are enabled, the graph is traversed by multiple tasks. Each
+// task owns a worklist, and a section is pushed to a worklist only by the
+// task that flipped its Live bit, so every section is visited once. When a
+// worklist grows large, half of it is handed off to a new task so that idle
+// threads can share the work.
+//
 //===----------------------------------------------------------------------===//
 
 #include "InputSection.h"
@@ -26,9 +32,9 @@
 #include "SymbolTable.h"
 #include "Symbols.h"
 #include "Writer.h"
+#include "lld/Core/Parallel.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Object/ELF.h"
-#include <functional>
 #include <vector>
 
 using namespace llvm;
@@ -38,24 +44,40 @@ using namespace llvm::object;
 using namespace lld;
 using namespace lld::elf;
 
-// Calls Fn for each section that Sec refers to via relocations.
+// Sets Sec's Live bit. Returns true if Sec is a regular input section whose
+// bit was not set before, which means that the caller is responsible for
+// visiting its successors.
+template <class ELFT> static bool markSection(InputSectionBase<ELFT> *Sec) {
+  if (!Sec || Sec->Live.load(std::memory_order_relaxed))
+    return false;
+  if (Sec->Live.exchange(true, std::memory_order_relaxed))
+    return false;
+  return isa<InputSection<ELFT>>(Sec);
+}
+
+// Worklists longer than this are split between two tasks.
+static const size_t SplitThreshold = 1024;
+
+// Visits all sections reachable from the sections in Q. If Tasks is not null,
+// part of the work may be spawned as new tasks in Tasks.
 template <class ELFT>
-static void forEachSuccessor(InputSection<ELFT> *Sec,
-                             std::function<void(InputSectionBase<ELFT> *)> Fn) {
-  typedef typename ELFT::Rel Elf_Rel;
-  typedef typename ELFT::Rela Elf_Rela;
-  typedef typename ELFT::Shdr Elf_Shdr;
-
-  ELFFile<ELFT> &Obj = Sec->getFile()->getObj();
-  for (const Elf_Shdr *RelSec : Sec->RelocSections) {
-    if (RelSec->sh_type == SHT_RELA) {
-      for (const Elf_Rela &RI : Obj.relas(RelSec))
-        if (InputSectionBase<ELFT> *Succ = Sec->getRelocTarget(RI))
-          Fn(Succ);
-    } else {
-      for (const Elf_Rel &RI : Obj.rels(RelSec))
-        if (InputSectionBase<ELFT> *Succ = Sec->getRelocTarget(RI))
-          Fn(Succ);
+static void markReachable(std::vector<InputSection<ELFT> *> Q,
+                          TaskGroup *Tasks) {
+  std::vector<Relocation<ELFT>> NonAllocRels;
+  while (!Q.empty()) {
+    InputSection<ELFT> *Sec = Q.back();
+    Q.pop_back();
+    for (const Relocation<ELFT> &Rel : Sec->getRelocations(NonAllocRels)) {
+      InputSectionBase<ELFT> *Succ = Sec->getRelocTarget(Rel);
+      if (markSection(Succ))
+        Q.push_back(cast<InputSection<ELFT>>(Succ));
+    }
+
+    if (Tasks && Q.size() >= SplitThreshold) {
+      std::vector<InputSection<ELFT> *> Rest(Q.begin() + Q.size() / 2,
+                                             Q.end());
+      Q.resize(Q.size() / 2);
+      Tasks->spawn([=] { markReachable<ELFT>(Rest, Tasks); });
     }
   }
 }
@@ -87,14 +109,11 @@ template <class ELFT> static bool isReserved(InputSectionBase<ELFT> *Sec) {
 // Starting from GC-root sections, this function visits all reachable
 // sections to set their "Live" bits.
 template <class ELFT> void elf::markLive(SymbolTable<ELFT> *Symtab) {
-  SmallVector<InputSection<ELFT> *, 256> Q;
+  std::vector<InputSection<ELFT> *> Q;
 
   auto Enqueue = [&](InputSectionBase<ELFT> *Sec) {
-    if (!Sec || Sec->Live)
-      return;
-    Sec->Live = true;
-    if (InputSection<ELFT> *S = dyn_cast<InputSection<ELFT>>(Sec))
-      Q.push_back(S);
+    if (markSection(Sec))
+      Q.push_back(cast<InputSection<ELFT>>(Sec));
   };
 
   auto MarkSymbol = [&](SymbolBody *Sym) {
@@ -113,8 +132,8 @@ template <class ELFT> void elf::markLive(SymbolTable<ELFT> *Symtab) {
   // Preserve externally-visible symbols if the symbols defined by this
   // file can interrupt other ELF file's symbols at runtime.
   if (Config->Shared || Config->ExportDynamic) {
-    for (const std::pair<StringRef, Symbol *> &P : Symtab->getSymbols()) {
-      SymbolBody *B = P.second->Body;
+    for (Symbol *S : Symtab->getSymbols()) {
+      SymbolBody *B = S->Body;
       if (B->getVisibility() == STV_DEFAULT)
         MarkSymbol(B);
     }
@@ -129,8 +148,20 @@ template <class ELFT> void elf::markLive(SymbolTable<ELFT> *Symtab) {
           Enqueue(Sec);
 
   // Mark all reachable sections.
-  while (!Q.empty())
-    forEachSuccessor<ELFT>(Q.pop_back_val(), Enqueue);
+  if (!Config->Threads) {
+    markReachable<ELFT>(std::move(Q), nullptr);
+    return;
+  }
+
+  // Start one task per chunk of roots. Tasks split their worklists
+  // further as they discover more sections.
+  TaskGroup Tasks;
+  for (size_t I = 0, E = Q.size(); I < E; I += SplitThreshold) {
+    std::vector<InputSection<ELFT> *> Roots(
+        Q.begin() + I, Q.begin() + std::min(E, I + SplitThreshold));
+    Tasks.spawn([=, &Tasks] { markReachable<ELFT>(Roots, &Tasks); });
+  }
+  Tasks.sync();
 }
 
 template void elf::markLive<ELF32LE>(SymbolTable<ELF32LE> *);
@@ -13,9 +13,12 @@
 #include "SymbolTable.h"
 #include "Target.h"
 #include "lld/Core/Parallel.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/Support/Dwarf.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MathExtras.h"
-#include <map>
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SHA1.h"
 
 using namespace llvm;
 using namespace llvm::dwarf;
@@ -361,18 +364,6 @@ HashTableSection<ELFT>::HashTableSection()
   this->Header.sh_addralign = sizeof(Elf_Word);
 }
 
-static uint32_t hashSysv(StringRef Name) {
-  uint32_t H = 0;
-  for (char C : Name) {
-    H = (H << 4) + C;
-    uint32_t G = H & 0xf0000000;
-    if (G)
-      H ^= G >> 24;
-    H &= ~G;
-  }
-  return H;
-}
-
 template <class ELFT> void HashTableSection<ELFT>::finalize() {
   this->Header.sh_link = Out<ELFT>::DynSymTab->SectionIndex;
 
@@ -406,13 +397,6 @@ template <class ELFT> void HashTableSection<ELFT>::writeTo(uint8_t *Buf) {
   }
 }
 
-static uint32_t hashGnu(StringRef Name) {
-  uint32_t H = 5381;
-  for (uint8_t C : Name)
-    H = (H << 5) + H + C;
-  return H;
-}
-
 template <class ELFT>
 GnuHashTableSection<ELFT>::GnuHashTableSection()
     : OutputSectionBase<ELFT>(".gnu.hash", SHT_GNU_HASH, SHF_ALLOC) {
@@ -543,7 +527,7 @@ void GnuHashTableSection<ELFT>::addSymbols(
   for (auto I = Mid, E = V.end(); I != E; ++I) {
     SymbolBody *B = I->first;
     size_t StrOff = I->second;
-    Symbols.push_back({B, StrOff, hashGnu(B->getName())});
+    Symbols.push_back({B, StrOff, B->getNameHash()});
   }
 
   unsigned NBuckets = calcNBuckets(Symbols.size());
@@ -755,19 +739,38 @@ template <class ELFT> void EhFrameHeader<ELFT>::writeTo(uint8_t *Buf) {
   uintX_t VA = this->getVA();
   uintX_t EhOff = EhVA - VA - 4;
   write32<E>(Buf + 4, EhOff);
-  write32<E>(Buf + 8, this->FdeList.size());
-  Buf += 12;
 
   // InitialPC -> Offset in .eh_frame, sorted by InitialPC.
-  std::map<uintX_t, size_t> PcToOffset;
-  for (const FdeData &F : FdeList)
-    PcToOffset[getFdePc(EhVA, F)] = F.Off;
+  // Initial PCs are read from the output buffer, which is independent
+  // for each FDE, so they are computed in parallel.
+  std::vector<std::pair<uintX_t, size_t>> PcToOffset(FdeList.size());
+  auto GetPc = [&](const FdeData &F) {
+    PcToOffset[&F - FdeList.data()] = {getFdePc(EhVA, F), F.Off};
+  };
+  if (Config->Threads) {
+    parallel_for_each(FdeList.begin(), FdeList.end(), GetPc);
+    parallel_sort(PcToOffset.data(), PcToOffset.data() + PcToOffset.size());
+  } else {
+    std::for_each(FdeList.begin(), FdeList.end(), GetPc);
+    std::sort(PcToOffset.begin(), PcToOffset.end());
+  }
+
+  // If two FDEs have the same initial PC, keep only the first one.
+  auto Eq = [](const std::pair<uintX_t, size_t> &A,
+               const std::pair<uintX_t, size_t> &B) {
+    return A.first == B.first;
+  };
+  PcToOffset.erase(std::unique(PcToOffset.begin(), PcToOffset.end(), Eq),
+                   PcToOffset.end());
+
+  write32<E>(Buf + 8, PcToOffset.size());
+  Buf += 12;
 
-  for (auto &I : PcToOffset) {
+  for (const std::pair<uintX_t, size_t> &P : PcToOffset) {
     // The first four bytes are an offset to the initial PC value for the FDE.
-    write32<E>(Buf, I.first - VA);
+    write32<E>(Buf, P.first - VA);
     // The last four bytes are an offset to the FDE data itself.
-    write32<E>(Buf + 4, EhVA + I.second - VA);
+    write32<E>(Buf + 4, EhVA + P.second - VA);
     Buf += 8;
   }
 }
@@ -821,12 +824,6 @@ void OutputSection<ELFT>::addSection(InputSectionBase<ELFT> *C) {
   Sections.push_back(S);
   S->OutSec = this;
   this->updateAlign(S->Align);
-
-  uintX_t Off = this->Header.sh_size;
-  Off = alignTo(Off, S->Align);
-  S->OutSecOff = Off;
-  Off += S->getSize();
-  this->Header.sh_size = Off;
 }
 
 // If an input string is in the form of "foo.N" where N is a number,
@@ -842,16 +839,71 @@ static int getPriority(StringRef S) {
   return V;
 }
 
-// This function is called after we sort input sections
-// to update their offsets.
-template <class ELFT> void OutputSection<ELFT>::reassignOffsets() {
+// Calls Fn(G, Begin, End) for each group G of at most GroupSize
+// consecutive elements out of NumElems, in parallel if --threads is given.
+template <class FnT>
+static void forEachGroup(size_t NumElems, size_t GroupSize, FnT Fn) {
+  size_t NumGroups = (NumElems + GroupSize - 1) / GroupSize;
+  auto Run = [&](size_t G) {
+    size_t Begin = G * GroupSize;
+    Fn(G, Begin, std::min(NumElems, Begin + GroupSize));
+  };
+  if (Config->Threads && NumGroups > 1)
+    parallel_for(size_t(0), NumGroups, size_t(1), Run);
+  else
+    for (size_t G = 0; G < NumGroups; ++G)
+      Run(G);
+}
+
+// Assigns offsets to input sections and computes the section size. This
+// is called after all input sections are added, and again whenever they
+// are reordered.
+//
+// Input sections are split into groups of a fixed number of sections.
+// Each group is laid out from offset zero independently of the others,
+// and then the groups are placed one after another, each at an offset
+// aligned to the largest alignment in the group, so that shifting a group
+// keeps its members aligned. Both the layout and the shifting of groups
+// can then be done in parallel. The grouping depends only on the number
+// of input sections, so the result does not depend on --threads, and an
+// output section with no more than GroupSize input sections is laid out
+// exactly as if offsets were assigned one by one.
+template <class ELFT> void OutputSection<ELFT>::assignOffsets() {
+  const size_t GroupSize = 10000;
+  size_t N = Sections.size();
+  size_t NumGroups = (N + GroupSize - 1) / GroupSize;
+  std::vector<uintX_t> Sizes(NumGroups);
+  std::vector<uintX_t> Aligns(NumGroups);
+
+  forEachGroup(N, GroupSize, [&](size_t G, size_t Begin, size_t End) {
+    uintX_t Off = 0;
+    uintX_t Align = 1;
+    for (size_t I = Begin; I < End; ++I) {
+      InputSection<ELFT> *S = Sections[I];
+      Off = alignTo(Off, S->Align);
+      S->OutSecOff = Off;
+      Off += S->getSize();
+      Align = std::max<uintX_t>(Align, S->Align);
+    }
+    Sizes[G] = Off;
+    Aligns[G] = Align;
+  });
+
+  // Turn group sizes into group offsets.
   uintX_t Off = 0;
-  for (InputSection<ELFT> *S : Sections) {
-    Off = alignTo(Off, S->Align);
-    S->OutSecOff = Off;
-    Off += S->getSize();
+  for (size_t G = 0; G < NumGroups; ++G) {
+    Off = alignTo(Off, Aligns[G]);
+    uintX_t Size = Sizes[G];
+    Sizes[G] = Off;
+    Off += Size;
   }
   this->Header.sh_size = Off;
+
+  forEachGroup(N, GroupSize, [&](size_t G, size_t Begin, size_t End) {
+    if (uintX_t Start = Sizes[G])
+      for (size_t I = Begin; I < End; ++I)
+        Sections[I]->OutSecOff += Start;
+  });
 }
 
 // Sorts input sections by section name suffixes, so that .foo.N comes
@@ -872,7 +924,7 @@ template <class ELFT> void OutputSection<ELFT>::sortInitFini() {
   Sections.clear();
   for (Pair &P : V)
     Sections.push_back(P.second);
-  reassignOffsets();
+  assignOffsets();
 }
 
 // Returns true if S matches /Filename.?\.o$/.
@@ -933,7 +985,7 @@ static bool compCtors(const InputSection<ELFT> *A,
 // Read the comment above.
 template <class ELFT> void OutputSection<ELFT>::sortCtorsDtors() {
   std::stable_sort(Sections.begin(), Sections.end(), compCtors<ELFT>);
-  reassignOffsets();
+  assignOffsets();
 }
 
 static void fill(uint8_t *Buf, size_t Size, ArrayRef<uint8_t> A) {
@@ -948,8 +1000,8 @@ template <class ELFT> void OutputSection<ELFT>::writeTo(uint8_t *Buf) {
   if (!Filler.empty())
     fill(Buf, this->getSize(), Filler);
   if (Config->Threads) {
-    parallel_for_each(Sections.begin(), Sections.end(),
-                      [=](InputSection<ELFT> *C) { C->writeTo(Buf); });
+    parallel_for(size_t(0), Sections.size(), size_t(16),
+                 [&](size_t I) { Sections[I]->writeTo(Buf); });
   } else {
     for (InputSection<ELFT> *C : Sections)
       C->writeTo(Buf);
@@ -969,10 +1021,10 @@ EHRegion<ELFT>::EHRegion(EHInputSection<ELFT> *S, unsigned Index)
 
 template <class ELFT> StringRef EHRegion<ELFT>::data() const {
   ArrayRef<uint8_t> SecData = S->getSectionData();
-  ArrayRef<std::pair<uintX_t, uintX_t>> Offsets = S->Offsets;
-  size_t Start = Offsets[Index].first;
-  size_t End =
-      Index == Offsets.size() - 1 ? SecData.size() : Offsets[Index + 1].first;
+  ArrayRef<SectionPiece<ELFT>> Offsets = S->Offsets;
+  size_t Start = Offsets[Index].InputOff;
+  size_t End = Index == Offsets.size() - 1 ? SecData.size()
+                                           : Offsets[Index + 1].InputOff;
   return StringRef((const char *)SecData.data() + Start, End - Start);
 }
 
@@ -1106,25 +1158,29 @@ static typename ELFT::uint readEntryLength(ArrayRef<uint8_t> D) {
 }
 
 template <class ELFT>
-template <class RelTy>
-void EHOutputSection<ELFT>::addSectionAux(EHInputSection<ELFT> *S,
-                                          iterator_range<const RelTy *> Rels) {
-  const endianness E = ELFT::TargetEndianness;
-
+void EHOutputSection<ELFT>::addSection(InputSectionBase<ELFT> *C) {
+  auto *S = cast<EHInputSection<ELFT>>(C);
   S->OutSec = this;
   this->updateAlign(S->Align);
   Sections.push_back(S);
+}
+
+// Splits S into CIEs and FDEs. This function does not modify this
+// output section, so it can be called for multiple sections in parallel.
+template <class ELFT>
+void EHOutputSection<ELFT>::parseSection(EHInputSection<ELFT> *S,
+                                         std::vector<EHEntry> &Entries) {
+  const endianness E = ELFT::TargetEndianness;
 
   ArrayRef<uint8_t> SecData = S->getSectionData();
   ArrayRef<uint8_t> D = SecData;
   uintX_t Offset = 0;
-  auto RelI = Rels.begin();
-  auto RelE = Rels.end();
+  auto RelI = S->Relocations.begin();
+  auto RelE = S->Relocations.end();
 
-  DenseMap<unsigned, unsigned> OffsetToIndex;
   while (!D.empty()) {
     unsigned Index = S->Offsets.size();
-    S->Offsets.push_back(std::make_pair(Offset, -1));
+    S->Offsets.emplace_back(Offset);
 
     uintX_t Length = readEntryLength<ELFT>(D);
     // If CIE/FDE data length is zero then Length is 4, this
@@ -1133,64 +1189,84 @@ void EHOutputSection<ELFT>::addSectionAux(EHInputSection<ELFT> *S,
       break;
     StringRef Entry((const char *)D.data(), Length);
 
-    while (RelI != RelE && RelI->r_offset < Offset)
+    while (RelI != RelE && RelI->Offset < Offset)
       ++RelI;
     uintX_t NextOffset = Offset + Length;
-    bool HasReloc = RelI != RelE && RelI->r_offset < NextOffset;
+    bool HasReloc = RelI != RelE && RelI->Offset < NextOffset;
 
+    EHEntry Ent = {};
+    Ent.Index = Index;
+    Ent.Length = Length;
     uint32_t ID = read32<E>(D.data() + 4);
     if (ID == 0) {
       // CIE
-      Cie<ELFT> C(S, Index);
+      Ent.IsCie = true;
       if (Config->EhFrameHdr)
-        C.FdeEncoding = getFdeEncoding(D);
+        Ent.FdeEncoding = getFdeEncoding(D);
 
       SymbolBody *Personality = nullptr;
-      if (HasReloc) {
-        uint32_t SymIndex = RelI->getSymbol(Config->Mips64EL);
-        Personality = &S->getFile()->getSymbolBody(SymIndex).repl();
-      }
-
-      std::pair<StringRef, SymbolBody *> CieInfo(Entry, Personality);
-      auto P = CieMap.insert(std::make_pair(CieInfo, Cies.size()));
-      if (P.second) {
-        Cies.push_back(C);
-        this->Header.sh_size += alignTo(Length, sizeof(uintX_t));
-      }
-      OffsetToIndex[Offset] = P.first->second;
+      if (HasReloc)
+        Personality = &RelI->Sym->repl();
+      Ent.Key = {Entry, Personality,
+                 (uint32_t)hash_combine(hash_value(Entry), Personality)};
     } else {
       if (!HasReloc)
         fatal("FDE doesn't reference another section");
       InputSectionBase<ELFT> *Target = S->getRelocTarget(*RelI);
-      if (Target && Target->Live) {
-        uint32_t CieOffset = Offset + 4 - ID;
-        auto I = OffsetToIndex.find(CieOffset);
-        if (I == OffsetToIndex.end())
-          fatal("invalid CIE reference");
-        Cies[I->second].Fdes.push_back(EHRegion<ELFT>(S, Index));
-        Out<ELFT>::EhFrameHdr->reserveFde();
-        this->Header.sh_size += alignTo(Length, sizeof(uintX_t));
-      }
+      Ent.Live = Target && Target->Live;
+      Ent.CieOffset = Offset + 4 - ID;
     }
+    Entries.push_back(Ent);
 
     Offset = NextOffset;
     D = D.slice(Length);
   }
-}
-
-template <class ELFT>
-void EHOutputSection<ELFT>::addSection(InputSectionBase<ELFT> *C) {
-  auto *S = cast<EHInputSection<ELFT>>(C);
-  const Elf_Shdr *RelSec = S->RelocSection;
-  if (!RelSec) {
-    addSectionAux(S, make_range<const Elf_Rela *>(nullptr, nullptr));
-    return;
-  }
-  ELFFile<ELFT> &Obj = S->getFile()->getObj();
-  if (RelSec->sh_type == SHT_RELA)
-    addSectionAux(S, Obj.relas(RelSec));
+  S->initOffsetMap();
+}
+
+template <class ELFT> void EHOutputSection<ELFT>::finalize() {
+  // Parsing is the expensive part, and input sections are independent
+  // of each other, so we parse them in parallel.
+  typedef std::pair<EHInputSection<ELFT> *, std::vector<EHEntry>> SecEntries;
+  std::vector<SecEntries> Parsed;
+  for (EHInputSection<ELFT> *S : Sections)
+    Parsed.push_back({S, {}});
+  auto Parse = [&](size_t I) {
+    parseSection(Parsed[I].first, Parsed[I].second);
+  };
+  if (Config->Threads)
+    parallel_for(size_t(0), Parsed.size(), size_t(1), Parse);
   else
-    addSectionAux(S, Obj.rels(RelSec));
+    for (size_t I = 0, E = Parsed.size(); I != E; ++I)
+      Parse(I);
+
+  // Deduplicate CIEs and attach live FDEs to them. This is done
+  // serially in input order so that the output is deterministic.
+  for (SecEntries &P : Parsed) {
+    EHInputSection<ELFT> *S = P.first;
+    DenseMap<uintX_t, unsigned> OffsetToIndex;
+    for (const EHEntry &Ent : P.second) {
+      if (Ent.IsCie) {
+        Cie<ELFT> C(S, Ent.Index);
+        C.FdeEncoding = Ent.FdeEncoding;
+        auto R = CieMap.insert(std::make_pair(Ent.Key, Cies.size()));
+        if (R.second) {
+          Cies.push_back(C);
+          this->Header.sh_size += alignTo(Ent.Length, sizeof(uintX_t));
+        }
+        OffsetToIndex[S->Offsets[Ent.Index].InputOff] = R.first->second;
+        continue;
+      }
+      if (!Ent.Live)
+        continue;
+      auto I = OffsetToIndex.find(Ent.CieOffset);
+      if (I == OffsetToIndex.end())
+        fatal("invalid CIE reference");
+      Cies[I->second].Fdes.push_back(EHRegion<ELFT>(S, Ent.Index));
+      Out<ELFT>::EhFrameHdr->reserveFde();
+      this->Header.sh_size += alignTo(Ent.Length, sizeof(uintX_t));
+    }
+  }
 }
 
 template <class ELFT>
@@ -1210,59 +1286,30 @@ template <class ELFT> void EHOutputSection<ELFT>::writeTo(uint8_t *Buf) {
     size_t CieOffset = Offset;
 
     uintX_t CIELen = writeAlignedCieOrFde<ELFT>(C.data(), Buf + Offset);
-    C.S->Offsets[C.Index].second = Offset;
+    C.S->Offsets[C.Index].OutputOff = Offset;
     Offset += CIELen;
 
     for (const EHRegion<ELFT> &F : C.Fdes) {
       uintX_t Len = writeAlignedCieOrFde<ELFT>(F.data(), Buf + Offset);
       write32<E>(Buf + Offset + 4, Offset + 4 - CieOffset); // Pointer
-      F.S->Offsets[F.Index].second = Offset;
+      F.S->Offsets[F.Index].OutputOff = Offset;
       Out<ELFT>::EhFrameHdr->addFde(C.FdeEncoding, Offset, Buf + Offset + 8);
       Offset += Len;
     }
   }
 
-  for (EHInputSection<ELFT> *S : Sections) {
-    const Elf_Shdr *RelSec = S->RelocSection;
-    if (!RelSec)
-      continue;
-    ELFFile<ELFT> &EObj = S->getFile()->getObj();
-    if (RelSec->sh_type == SHT_RELA)
-      S->relocate(Buf, nullptr, EObj.relas(RelSec));
-    else
-      S->relocate(Buf, nullptr, EObj.rels(RelSec));
-  }
+  for (EHInputSection<ELFT> *S : Sections)
+    S->relocate(Buf, nullptr);
 }
 
 template <class ELFT>
 MergeOutputSection<ELFT>::MergeOutputSection(StringRef Name, uint32_t Type,
                                              uintX_t Flags, uintX_t Alignment)
-    : OutputSectionBase<ELFT>(Name, Type, Flags),
-      Builder(llvm::StringTableBuilder::RAW, Alignment) {}
+    : OutputSectionBase<ELFT>(Name, Type, Flags), Alignment(Alignment) {}
 
 template <class ELFT> void MergeOutputSection<ELFT>::writeTo(uint8_t *Buf) {
-  if (shouldTailMerge()) {
-    StringRef Data = Builder.data();
-    memcpy(Buf, Data.data(), Data.size());
-    return;
-  }
-  for (const std::pair<StringRef, size_t> &P : Builder.getMap()) {
-    StringRef Data = P.first;
-    memcpy(Buf + P.second, Data.data(), Data.size());
-  }
-}
-
-static size_t findNull(StringRef S, size_t EntSize) {
-  // Optimize the common case.
-  if (EntSize == 1)
-    return S.find(0);
-
-  for (unsigned I = 0, N = S.size(); I != N; I += EntSize) {
-    const char *B = S.begin() + I;
-    if (std::all_of(B, B + EntSize, [](char C) { return C == 0; }))
-      return I;
-  }
-  return StringRef::npos;
+  for (const std::pair<StringRef, uintX_t> &P : Pieces)
+    memcpy(Buf + P.second, P.first.data(), P.first.size());
 }
 
 template <class ELFT>
@@ -1270,52 +1317,187 @@ void MergeOutputSection<ELFT>::addSection(InputSectionBase<ELFT> *C) {
   auto *S = cast<MergeInputSection<ELFT>>(C);
   S->OutSec = this;
   this->updateAlign(S->Align);
+  Sections.push_back(S);
+  this->Header.sh_entsize = S->getSectionHdr()->sh_entsize;
+}
 
-  ArrayRef<uint8_t> D = S->getSectionData();
-  StringRef Data((const char *)D.data(), D.size());
-  uintX_t EntSize = S->getSectionHdr()->sh_entsize;
-  this->Header.sh_entsize = EntSize;
-
-  // If this is of type string, the contents are null-terminated strings.
-  if (this->Header.sh_flags & SHF_STRINGS) {
-    uintX_t Offset = 0;
-    while (!Data.empty()) {
-      size_t End = findNull(Data, EntSize);
-      if (End == StringRef::npos)
-        fatal("string is not null terminated");
-      StringRef Entry = Data.substr(0, End + EntSize);
-      uintX_t OutputOffset = Builder.add(Entry);
-      if (shouldTailMerge())
-        OutputOffset = -1;
-      S->Offsets.push_back(std::make_pair(Offset, OutputOffset));
-      uintX_t Size = End + EntSize;
-      Data = Data.substr(Size);
-      Offset += Size;
-    }
+template <class ELFT> bool MergeOutputSection<ELFT>::shouldTailMerge() const {
+  return Config->Optimize >= 2 && this->Header.sh_flags & SHF_STRINGS;
+}
+
+namespace {
+// A piece of a mergeable section with its precomputed hash value.
+struct MergeKey {
+  StringRef Data;
+  uint32_t Hash;
+};
+}
+
+namespace llvm {
+template <> struct DenseMapInfo<MergeKey> {
+  static MergeKey getEmptyKey() {
+    return {DenseMapInfo<StringRef>::getEmptyKey(), 0};
+  }
+  static MergeKey getTombstoneKey() {
+    return {DenseMapInfo<StringRef>::getTombstoneKey(), 0};
+  }
+  static unsigned getHashValue(const MergeKey &K) { return K.Hash; }
+  static bool isEqual(const MergeKey &A, const MergeKey &B) {
+    return A.Hash == B.Hash && DenseMapInfo<StringRef>::isEqual(A.Data, B.Data);
+  }
+};
+}
+
+// Pieces are distributed to shards by the high bits of their hash values,
+// so that the low bits are still useful for the hash tables in each shard.
+static size_t getShardId(uint32_t Hash, size_t NumShards) {
+  return ((uint64_t)Hash * NumShards) >> 32;
+}
+
+// Returns the character at Pos counting from the end of S,
+// or -1 if S is not longer than Pos.
+static int charTailAt(StringRef S, size_t Pos) {
+  if (Pos >= S.size())
+    return -1;
+  return (unsigned char)S[S.size() - Pos - 1];
+}
+
+// Three-way radix quicksort on reversed strings. Strings are sorted in
+// descending order, so that if a string is a suffix of other strings,
+// it comes right after one of them. This is much faster than std::sort
+// with a reversed string comparison because it does not compare
+// characters that are already known to be the same. If Tasks is not
+// null, large partitions are sorted in parallel.
+template <class T>
+static void multikeySort(T *Begin, T *End, size_t Pos, TaskGroup *Tasks) {
+tailcall:
+  if (End - Begin <= 1)
     return;
+
+  // Partition items. Items in [Begin, P) are greater than the pivot,
+  // [P, Q) are the same as the pivot, and [Q, End) are less than the pivot.
+  int Pivot = charTailAt(Begin->first, Pos);
+  T *P = Begin;
+  T *Q = End;
+  for (T *R = Begin + 1; R < Q;) {
+    int C = charTailAt(R->first, Pos);
+    if (C > Pivot)
+      std::swap(*P++, *R++);
+    else if (C < Pivot)
+      std::swap(*--Q, *R);
+    else
+      R++;
   }
 
-  // If this is not of type string, every entry has the same size.
-  for (unsigned I = 0, N = Data.size(); I != N; I += EntSize) {
-    StringRef Entry = Data.substr(I, EntSize);
-    size_t OutputOffset = Builder.add(Entry);
-    S->Offsets.push_back(std::make_pair(I, OutputOffset));
+  if (Tasks && End - Begin > 4096) {
+    Tasks->spawn([=] { multikeySort(Begin, P, Pos, Tasks); });
+    Tasks->spawn([=] { multikeySort(Q, End, Pos, Tasks); });
+  } else {
+    multikeySort(Begin, P, Pos, Tasks);
+    multikeySort(Q, End, Pos, Tasks);
+  }
+  if (Pivot != -1) {
+    // multikeySort(P, Q, Pos + 1, Tasks), but with tail call optimization.
+    Begin = P;
+    End = Q;
+    ++Pos;
+    goto tailcall;
   }
 }
 
+// Assigns offsets to unique strings so that a string that is a suffix
+// of another string shares the tail of that string.
 template <class ELFT>
-unsigned MergeOutputSection<ELFT>::getOffset(StringRef Val) {
-  return Builder.getOffset(Val);
-}
+void MergeOutputSection<ELFT>::tailMerge(
+    std::vector<std::pair<StringRef, uintX_t *>> &Strings) {
+  if (Config->Threads) {
+    TaskGroup Tasks;
+    multikeySort(Strings.data(), Strings.data() + Strings.size(), 0, &Tasks);
+    Tasks.sync();
+  } else {
+    multikeySort(Strings.data(), Strings.data() + Strings.size(), 0, nullptr);
+  }
 
-template <class ELFT> bool MergeOutputSection<ELFT>::shouldTailMerge() const {
-  return Config->Optimize >= 2 && this->Header.sh_flags & SHF_STRINGS;
+  uintX_t Off = 0;
+  StringRef Previous;
+  for (std::pair<StringRef, uintX_t *> &P : Strings) {
+    StringRef S = P.first;
+    if (Previous.endswith(S)) {
+      uintX_t Pos = Off - S.size();
+      if (!(Pos & (Alignment - 1))) {
+        *P.second = Pos;
+        continue;
+      }
+    }
+    Off = alignTo(Off, Alignment);
+    *P.second = Off;
+    Pieces.push_back(std::make_pair(S, Off));
+    Off += S.size();
+    Previous = S;
+  }
+  this->Header.sh_size = Off;
 }
 
 template <class ELFT> void MergeOutputSection<ELFT>::finalize() {
-  if (shouldTailMerge())
-    Builder.finalize();
-  this->Header.sh_size = Builder.getSize();
+  size_t NumPieces = 0;
+  for (MergeInputSection<ELFT> *S : Sections)
+    NumPieces += S->Offsets.size();
+
+  // For each piece, find the first piece that has the same contents.
+  // Pieces are partitioned into shards by hash value, and each shard
+  // is deduplicated independently of the others. Because every shard
+  // visits pieces in input order, the result does not depend on the
+  // number of shards or on thread scheduling.
+  std::vector<uintX_t *> Leaders(NumPieces);
+  size_t NumShards = Config->Threads ? 32 : 1;
+  auto Dedup = [&](size_t Shard) {
+    DenseMap<MergeKey, uintX_t *> Map;
+    size_t Id = 0;
+    for (MergeInputSection<ELFT> *S : Sections) {
+      for (size_t I = 0, E = S->Offsets.size(); I != E; ++I, ++Id) {
+        SectionPiece<ELFT> &Piece = S->Offsets[I];
+        if (getShardId(Piece.Hash, NumShards) != Shard)
+          continue;
+        MergeKey Key = {S->getPieceData(I), Piece.Hash};
+        Leaders[Id] = Map.insert({Key, &Piece.OutputOff}).first->second;
+      }
+    }
+  };
+  if (NumShards == 1) {
+    Dedup(0);
+  } else {
+    TaskGroup Tasks;
+    for (size_t Shard = 0; Shard < NumShards; ++Shard)
+      Tasks.spawn([=] { Dedup(Shard); });
+    Tasks.sync();
+  }
+
+  // Collect pieces that appear first. Duplicates will share their offsets.
+  std::vector<std::pair<StringRef, uintX_t *>> Uniques;
+  size_t Id = 0;
+  for (MergeInputSection<ELFT> *S : Sections)
+    for (size_t I = 0, E = S->Offsets.size(); I != E; ++I, ++Id)
+      if (Leaders[Id] == &S->Offsets[I].OutputOff)
+        Uniques.push_back(std::make_pair(S->getPieceData(I), Leaders[Id]));
+
+  if (shouldTailMerge()) {
+    tailMerge(Uniques);
+  } else {
+    // Assign offsets to unique pieces in the order they first appear.
+    uintX_t Off = 0;
+    for (std::pair<StringRef, uintX_t *> &P : Uniques) {
+      Off = alignTo(Off, Alignment);
+      *P.second = Off;
+      Pieces.push_back(std::make_pair(P.first, Off));
+      Off += P.first.size();
+    }
+    this->Header.sh_size = Off;
+  }
+
+  Id = 0;
+  for (MergeInputSection<ELFT> *S : Sections)
+    for (size_t I = 0, E = S->Offsets.size(); I != E; ++I, ++Id)
+      S->Offsets[I].OutputOff = *Leaders[Id];
 }
 
 template <class ELFT>
@@ -1549,33 +1731,111 @@ uint8_t SymbolTableSection<ELFT>::getSymbolBinding(SymbolBody *Body) {
 }
 
 template <class ELFT>
-BuildIdSection<ELFT>::BuildIdSection()
-    : OutputSectionBase<ELFT>(".note.gnu.build-id", SHT_NOTE, SHF_ALLOC) {
-  // 16 bytes for the note section header and 8 bytes for FNV1 hash.
-  this->Header.sh_size = 24;
+BuildIdSection<ELFT>::BuildIdSection(size_t HashSize)
+    : OutputSectionBase<ELFT>(".note.gnu.build-id", SHT_NOTE, SHF_ALLOC),
+      HashSize(HashSize) {
+  // 16 bytes for the note section header.
+  this->Header.sh_size = 16 + HashSize;
 }
 
 template <class ELFT> void BuildIdSection<ELFT>::writeTo(uint8_t *Buf) {
   const endianness E = ELFT::TargetEndianness;
   write32<E>(Buf, 4);                   // Name size
-  write32<E>(Buf + 4, sizeof(Hash));    // Content size
+  write32<E>(Buf + 4, HashSize);        // Content size
   write32<E>(Buf + 8, NT_GNU_BUILD_ID); // Type
   memcpy(Buf + 12, "GNU", 4);           // Name string
   HashBuf = Buf + 16;
 }
 
-template <class ELFT> void BuildIdSection<ELFT>::update(ArrayRef<uint8_t> Buf) {
-  // 64-bit FNV1 hash
-  const uint64_t Prime = 0x100000001b3;
-  for (uint8_t B : Buf) {
-    Hash *= Prime;
-    Hash ^= B;
+// Computes a hash value of Bufs using a given function and writes it to
+// the section. Hash(Data, Dest) hashes Data and writes a HashSize-byte
+// value to Dest.
+//
+// Hashing a large output file is slow, so the input is split into
+// fixed-size chunks which are hashed in parallel if --threads is given.
+// The hash values of the chunks are then hashed again to get the final
+// value. The result does not depend on whether --threads is given.
+template <class ELFT>
+template <class HashFn>
+void BuildIdSection<ELFT>::computeHash(ArrayRef<ArrayRef<uint8_t>> Bufs,
+                                       HashFn Hash) {
+  const size_t ChunkSize = 1024 * 1024;
+  std::vector<ArrayRef<uint8_t>> Chunks;
+  for (ArrayRef<uint8_t> B : Bufs) {
+    while (B.size() > ChunkSize) {
+      Chunks.push_back(B.slice(0, ChunkSize));
+      B = B.slice(ChunkSize);
+    }
+    if (!B.empty())
+      Chunks.push_back(B);
   }
+
+  std::vector<uint8_t> Hashes(Chunks.size() * HashSize);
+  if (Config->Threads) {
+    TaskGroup Tasks;
+    for (size_t I = 0, E = Chunks.size(); I < E; ++I)
+      Tasks.spawn([&, I] { Hash(Chunks[I], Hashes.data() + I * HashSize); });
+    Tasks.sync();
+  } else {
+    for (size_t I = 0, E = Chunks.size(); I < E; ++I)
+      Hash(Chunks[I], Hashes.data() + I * HashSize);
+  }
+  Hash(Hashes, HashBuf);
 }
 
-template <class ELFT> void BuildIdSection<ELFT>::writeBuildId() {
-  const endianness E = ELFT::TargetEndianness;
-  write64<E>(HashBuf, Hash);
+template <class ELFT>
+void BuildIdFnv1<ELFT>::writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) {
+  this->computeHash(Bufs, [](ArrayRef<uint8_t> Data, uint8_t *Dest) {
+    // 64-bit FNV1 hash
+    uint64_t Hash = 0xcbf29ce484222325;
+    const uint64_t Prime = 0x100000001b3;
+    for (uint8_t B : Data) {
+      Hash *= Prime;
+      Hash ^= B;
+    }
+    write64<ELFT::TargetEndianness>(Dest, Hash);
+  });
+}
+
+template <class ELFT>
+void BuildIdMd5<ELFT>::writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) {
+  this->computeHash(Bufs, [](ArrayRef<uint8_t> Data, uint8_t *Dest) {
+    MD5 Hash;
+    Hash.update(Data);
+    MD5::MD5Result Res;
+    Hash.final(Res);
+    memcpy(Dest, Res, 16);
+  });
+}
+
+template <class ELFT>
+void BuildIdSha1<ELFT>::writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) {
+  this->computeHash(Bufs, [](ArrayRef<uint8_t> Data, uint8_t *Dest) {
+    SHA1 Hash;
+    Hash.update(Data);
+    memcpy(Dest, Hash.final().data(), 20);
+  });
+}
+
+// Fills the build ID with random bytes. The result is formatted as
+// a version 4 (random) UUID as described in RFC 4122.
+template <class ELFT>
+void BuildIdUuid<ELFT>::writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) {
+  uint8_t *Buf = this->HashBuf;
+  for (size_t I = 0; I < 16; I += 4)
+    write32le(Buf + I, sys::Process::GetRandomNumber());
+  Buf[6] = (Buf[6] & 0x0f) | 0x40;
+  Buf[8] = (Buf[8] & 0x3f) | 0x80;
+}
+
+template <class ELFT>
+BuildIdHexstring<ELFT>::BuildIdHexstring()
+    : BuildIdSection<ELFT>(Config->BuildIdVector.size()) {}
+
+template <class ELFT>
+void BuildIdHexstring<ELFT>::writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) {
+  memcpy(this->HashBuf, Config->BuildIdVector.data(),
+         Config->BuildIdVector.size());
 }
 
 template <class ELFT>
@@ -1686,5 +1946,30 @@ template class BuildIdSection<ELF32LE>;
 template class BuildIdSection<ELF32BE>;
 template class BuildIdSection<ELF64LE>;
 template class BuildIdSection<ELF64BE>;
+
+template class BuildIdFnv1<ELF32LE>;
+template class BuildIdFnv1<ELF32BE>;
+template class BuildIdFnv1<ELF64LE>;
+template class BuildIdFnv1<ELF64BE>;
+
+template class BuildIdMd5<ELF32LE>;
+template class BuildIdMd5<ELF32BE>;
+template class BuildIdMd5<ELF64LE>;
+template class BuildIdMd5<ELF64BE>;
+
+template class BuildIdSha1<ELF32LE>;
+template class BuildIdSha1<ELF32BE>;
+template class BuildIdSha1<ELF64LE>;
+template class BuildIdSha1<ELF64BE>;
+
+template class BuildIdUuid<ELF32LE>;
+template class BuildIdUuid<ELF32BE>;
+template class BuildIdUuid<ELF64LE>;
+template class BuildIdUuid<ELF64BE>;
+
+template class BuildIdHexstring<ELF32LE>;
+template class BuildIdHexstring<ELF32BE>;
+template class BuildIdHexstring<ELF64LE>;
+template class BuildIdHexstring<ELF64BE>;
 }
 }
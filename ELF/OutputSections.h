@@ -14,7 +14,6 @@
 
 #include "lld/Core/LLVM.h"
 #include "llvm/ADT/SmallPtrSet.h"
-#include "llvm/MC/StringTableBuilder.h"
 #include "llvm/Object/ELF.h"
 
 namespace lld {
@@ -55,7 +54,10 @@ public:
   typedef typename ELFT::uint uintX_t;
   typedef typename ELFT::Shdr Elf_Shdr;
 
+  enum Kind { Generic, EHFrame, Regular };
+
   OutputSectionBase(StringRef Name, uint32_t Type, uintX_t Flags);
+  virtual Kind getKind() const { return Generic; }
   void setVA(uintX_t VA) { Header.sh_addr = VA; }
   uintX_t getVA() const { return Header.sh_addr; }
   void setFileOffset(uintX_t Off) { Header.sh_offset = Off; }
@@ -261,6 +263,7 @@ private:
 template <class ELFT>
 class OutputSection final : public OutputSectionBase<ELFT> {
 public:
+  typedef OutputSectionBase<ELFT> Base;
   typedef typename ELFT::Shdr Elf_Shdr;
   typedef typename ELFT::Sym Elf_Sym;
   typedef typename ELFT::Rel Elf_Rel;
@@ -268,13 +271,15 @@ public:
   typedef typename ELFT::uint uintX_t;
   OutputSection(StringRef Name, uint32_t Type, uintX_t Flags);
   void addSection(InputSectionBase<ELFT> *C) override;
+  void assignOffsets();
   void sortInitFini();
   void sortCtorsDtors();
   void writeTo(uint8_t *Buf) override;
   void finalize() override;
+  typename Base::Kind getKind() const override { return Base::Regular; }
+  static bool classof(const Base *B) { return B->getKind() == Base::Regular; }
 
 private:
-  void reassignOffsets();
   std::vector<InputSection<ELFT> *> Sections;
 };
 
@@ -289,11 +294,17 @@ public:
                      uintX_t Alignment);
   void addSection(InputSectionBase<ELFT> *S) override;
   void writeTo(uint8_t *Buf) override;
-  unsigned getOffset(StringRef Val);
   void finalize() override;
 
 private:
-  llvm::StringTableBuilder Builder;
+  void tailMerge(std::vector<std::pair<StringRef, uintX_t *>> &Strings);
+
+  std::vector<MergeInputSection<ELFT> *> Sections;
+
+  // Unique pieces and their offsets in this output section.
+  std::vector<std::pair<StringRef, uintX_t>> Pieces;
+
+  uintX_t Alignment;
 };
 
 // FDE or CIE
@@ -311,6 +322,14 @@ template <class ELFT> struct Cie : public EHRegion<ELFT> {
   uint8_t FdeEncoding;
 };
 
+// Identifies a CIE by its contents and personality function. The hash
+// value is computed in advance because CIEs are parsed in parallel.
+struct CieKey {
+  StringRef Data;
+  SymbolBody *Personality;
+  uint32_t Hash;
+};
+
 template <class ELFT>
 class EHOutputSection final : public OutputSectionBase<ELFT> {
 public:
@@ -318,23 +337,41 @@ public:
   typedef typename ELFT::Shdr Elf_Shdr;
   typedef typename ELFT::Rel Elf_Rel;
   typedef typename ELFT::Rela Elf_Rela;
+  typedef OutputSectionBase<ELFT> Base;
   EHOutputSection(StringRef Name, uint32_t Type, uintX_t Flags);
   void writeTo(uint8_t *Buf) override;
-
-  template <class RelTy>
-  void addSectionAux(EHInputSection<ELFT> *S,
-                     llvm::iterator_range<const RelTy *> Rels);
+  typename Base::Kind getKind() const override { return Base::EHFrame; }
+  static bool classof(const Base *B) { return B->getKind() == Base::EHFrame; }
 
   void addSection(InputSectionBase<ELFT> *S) override;
+  void finalize() override;
 
 private:
+  // A CIE or FDE read from an input section.
+  struct EHEntry {
+    // The index of the piece in the input section.
+    unsigned Index;
+    uintX_t Length;
+    bool IsCie;
+
+    // Used only for CIEs.
+    CieKey Key;
+    uint8_t FdeEncoding;
+
+    // Used only for FDEs. CieOffset is an input section offset.
+    uintX_t CieOffset;
+    bool Live;
+  };
+
+  void parseSection(EHInputSection<ELFT> *S, std::vector<EHEntry> &Entries);
+
   uint8_t getFdeEncoding(ArrayRef<uint8_t> D);
 
   std::vector<EHInputSection<ELFT> *> Sections;
   std::vector<Cie<ELFT>> Cies;
 
   // Maps CIE content + personality to a index in Cies.
-  llvm::DenseMap<std::pair<StringRef, SymbolBody *>, unsigned> CieMap;
+  llvm::DenseMap<CieKey, unsigned> CieMap;
 };
 
 template <class ELFT>
@@ -507,16 +544,49 @@ private:
 };
 
 template <class ELFT>
-class BuildIdSection final : public OutputSectionBase<ELFT> {
+class BuildIdSection : public OutputSectionBase<ELFT> {
 public:
-  BuildIdSection();
   void writeTo(uint8_t *Buf) override;
-  void update(ArrayRef<uint8_t> Buf);
-  void writeBuildId();
+  virtual void writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) = 0;
 
-private:
-  uint64_t Hash = 0xcbf29ce484222325; // FNV1 hash basis
-  uint8_t *HashBuf;
+protected:
+  BuildIdSection(size_t HashSize);
+  template <class HashFn>
+  void computeHash(ArrayRef<ArrayRef<uint8_t>> Bufs, HashFn Hash);
+
+  size_t HashSize;
+  uint8_t *HashBuf = nullptr;
+};
+
+template <class ELFT> class BuildIdFnv1 final : public BuildIdSection<ELFT> {
+public:
+  BuildIdFnv1() : BuildIdSection<ELFT>(8) {}
+  void writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) override;
+};
+
+template <class ELFT> class BuildIdMd5 final : public BuildIdSection<ELFT> {
+public:
+  BuildIdMd5() : BuildIdSection<ELFT>(16) {}
+  void writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) override;
+};
+
+template <class ELFT> class BuildIdSha1 final : public BuildIdSection<ELFT> {
+public:
+  BuildIdSha1() : BuildIdSection<ELFT>(20) {}
+  void writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) override;
+};
+
+template <class ELFT> class BuildIdUuid final : public BuildIdSection<ELFT> {
+public:
+  BuildIdUuid() : BuildIdSection<ELFT>(16) {}
+  void writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) override;
+};
+
+template <class ELFT>
+class BuildIdHexstring final : public BuildIdSection<ELFT> {
+public:
+  BuildIdHexstring();
+  void writeBuildId(ArrayRef<ArrayRef<uint8_t>> Bufs) override;
 };
 
 // All output sections that are hadnled by the linker specially are
@@ -577,4 +647,20 @@ template <class ELFT> OutputSectionBase<ELFT> *Out<ELFT>::ProgramHeaders;
 } // namespace elf
 } // namespace lld
 
+namespace llvm {
+template <> struct DenseMapInfo<lld::elf::CieKey> {
+  static lld::elf::CieKey getEmptyKey() {
+    return {DenseMapInfo<StringRef>::getEmptyKey(), nullptr, 0};
+  }
+  static lld::elf::CieKey getTombstoneKey() {
+    return {DenseMapInfo<StringRef>::getTombstoneKey(), nullptr, 0};
+  }
+  static unsigned getHashValue(const lld::elf::CieKey &K) { return K.Hash; }
+  static bool isEqual(const lld::elf::CieKey &A, const lld::elf::CieKey &B) {
+    return A.Hash == B.Hash && A.Personality == B.Personality &&
+           DenseMapInfo<StringRef>::isEqual(A.Data, B.Data);
+  }
+};
+}
+
 #endif // LLD_ELF_OUTPUT_SECTIONS_H
@@ -18,6 +18,7 @@
 #include "Config.h"
 #include "Error.h"
 #include "Symbols.h"
+#include "lld/Core/Parallel.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/StringSaver.h"
 
@@ -32,16 +33,29 @@ using namespace lld::elf;
 // (e.g. it does not make sense to link x86 object files with
 // MIPS object files.) This function checks for that error.
 template <class ELFT> static bool isCompatible(InputFile *FileP) {
-  auto *F = dyn_cast<ELFFileBase<ELFT>>(FileP);
-  if (!F)
+  ELFKind Kind;
+  uint16_t Machine;
+  if (auto *F = dyn_cast<ELFFileBase<ELFT>>(FileP)) {
+    Kind = F->getELFKind();
+    Machine = F->getEMachine();
+  } else if (auto *F = dyn_cast<LazyObjectFile>(FileP)) {
+    Kind = F->getELFKind();
+    Machine = F->getEMachine();
+  } else {
     return true;
-  if (F->getELFKind() == Config->EKind && F->getEMachine() == Config->EMachine)
+  }
+  if (Kind == Config->EKind && Machine == Config->EMachine)
     return true;
-  StringRef A = F->getName();
+
+  // FirstElf is not set if the target was determined by a lazy object file.
+  StringRef A = FileP->getName();
   StringRef B = Config->Emulation;
-  if (B.empty())
+  if (B.empty() && Config->FirstElf)
     B = Config->FirstElf->getName();
-  error(A + " is incompatible with " + B);
+  if (B.empty())
+    error(A + " is incompatible with the other input files");
+  else
+    error(A + " is incompatible with " + B);
   return false;
 }
 
@@ -61,15 +75,43 @@ void SymbolTable<ELFT>::addFile(std::unique_ptr<InputFile> File) {
     return;
   }
 
+  // Object file between --start-lib and --end-lib
+  if (auto *F = dyn_cast<LazyObjectFile>(FileP)) {
+    LazyObjectFiles.emplace_back(cast<LazyObjectFile>(File.release()));
+    F->parse<ELFT>();
+    for (Lazy &Sym : F->getLazySymbols())
+      addLazy(&Sym);
+    return;
+  }
+
   // .so file
   if (auto *F = dyn_cast<SharedFile<ELFT>>(FileP)) {
     // DSOs are uniquified not by filename but by soname.
-    F->parseSoName();
+    if (!F->Preparsed)
+      F->parseSoName();
     if (!SoNames.insert(F->getSoName()).second)
       return;
 
     SharedFiles.emplace_back(cast<SharedFile<ELFT>>(File.release()));
-    F->parseRest();
+    if (!F->Preparsed)
+      F->parseRest();
+
+    // With --lazy-shared-symbols, only names that are already in the
+    // symbol table are looked up now. Names added later are looked up
+    // by insert(). Symbols of a library that precedes the files referring
+    // to them are therefore added to SymVector in the order in which they
+    // are referenced rather than in the library's order, so .dynsym and
+    // .symtab may be ordered differently than without the option.
+    if (F->isLazy()) {
+      LazySharedFiles.push_back(F);
+      for (size_t I = 0, E = SymVector.size(); I != E; ++I) {
+        SymbolBody *B = SymVector[I]->Body;
+        for (SharedSymbol<ELFT> *S :
+             F->findSymbols(B->getName(), B->getNameHash()))
+          resolve(S);
+      }
+      return;
+    }
     for (SharedSymbol<ELFT> &B : F->getSharedSymbols())
       resolve(&B);
     return;
@@ -93,6 +135,55 @@ void SymbolTable<ELFT>::addFile(std::unique_ptr<InputFile> File) {
     resolve(B);
 }
 
+// Returns true if F is an ELF file of the same class and byte order as ELFT.
+template <class ELFT> static bool isElfType(InputFile *F) {
+  std::pair<unsigned char, unsigned char> Type =
+      getElfArchType(F->MB.getBuffer());
+  unsigned char Class = ELFT::Is64Bits ? ELFCLASS64 : ELFCLASS32;
+  unsigned char Data =
+      ELFT::TargetEndianness == support::little ? ELFDATA2LSB : ELFDATA2MSB;
+  return Type.first == Class && Type.second == Data;
+}
+
+// Reads section and symbol tables of an object file or a shared object
+// file. This does not depend on any other files, so it can run in
+// parallel with addFile() for preceding files. Incompatible files are
+// skipped here and reported by addFile().
+template <class ELFT> static void preparseFile(InputFile *FileP) {
+  if (!isa<ELFFileBase<ELFT>>(FileP) || !isElfType<ELFT>(FileP))
+    return;
+  if (cast<ELFFileBase<ELFT>>(FileP)->getEMachine() != Config->EMachine)
+    return;
+  if (auto *F = dyn_cast<ObjectFile<ELFT>>(FileP))
+    F->preparse();
+  else
+    cast<SharedFile<ELFT>>(FileP)->preparse();
+}
+
+// The number of files that may be parsed ahead of symbol resolution.
+// Parsed files hold their section and symbol tables, so this bounds
+// memory usage while keeping all threads busy.
+static const size_t ParseAheadWindow = 64;
+
+// Adds files to the symbol table in the given order. With --threads,
+// files are parsed in parallel, and each file's symbols are resolved
+// as soon as it and all files before it have been parsed, while later
+// files are still being read and parsed. Resolving symbols depends on
+// the order of files, so it is still done serially by addFile().
+template <class ELFT>
+void SymbolTable<ELFT>::addFiles(
+    MutableArrayRef<std::unique_ptr<InputFile>> Files) {
+  if (!Config->Threads) {
+    for (std::unique_ptr<InputFile> &F : Files)
+      addFile(std::move(F));
+    return;
+  }
+  parallel_pipeline(
+      size_t(0), Files.size(), ParseAheadWindow,
+      [&](size_t I) { preparseFile<ELFT>(Files[I].get()); },
+      [&](size_t I) { addFile(std::move(Files[I])); });
+}
+
 template <class ELFT> void SymbolTable<ELFT>::addCombinedLtoObject() {
   if (BitcodeFiles.empty())
     return;
@@ -162,7 +253,7 @@ SymbolBody *SymbolTable<ELFT>::addIgnored(StringRef Name) {
 // Rename SYM as __wrap_SYM. The original symbol is preserved as __real_SYM.
 // Used to implement --wrap.
 template <class ELFT> void SymbolTable<ELFT>::wrap(StringRef Name) {
-  if (Symtab.count(Name) == 0)
+  if (!find(Name))
     return;
   StringSaver Saver(Alloc);
   Symbol *Sym = addUndefined(Name)->getSymbol();
@@ -249,19 +340,47 @@ template <class ELFT> void SymbolTable<ELFT>::resolve(SymbolBody *New) {
 
 // Find an existing symbol or create and insert a new one.
 template <class ELFT> Symbol *SymbolTable<ELFT>::insert(SymbolBody *New) {
-  StringRef Name = New->getName();
-  Symbol *&Sym = Symtab[Name];
-  if (!Sym)
+  SymName Name(New->getName(), New->getNameHash());
+  auto P = Symtab.insert(std::make_pair(Name, (unsigned)SymVector.size()));
+  Symbol *Sym;
+  if (P.second) {
     Sym = new (Alloc) Symbol{New};
+    SymVector.push_back(Sym);
+    if (!LazySharedFiles.empty())
+      importSharedSymbols(Sym, Name);
+  } else {
+    Sym = SymVector[P.first->second];
+  }
   New->setBackref(Sym);
   return Sym;
 }
 
+// Looks up Name in shared files whose symbols are read on demand, and
+// resolves the symbols found as if they were added when the files were
+// read, that is, before the symbol that is being inserted to Sym.
+template <class ELFT>
+void SymbolTable<ELFT>::importSharedSymbols(Symbol *Sym, SymName Name) {
+  SymbolBody *New = Sym->Body;
+  Sym->Body = nullptr;
+  for (SharedFile<ELFT> *F : LazySharedFiles) {
+    for (SharedSymbol<ELFT> *S : F->findSymbols(Name.Name, Name.Hash)) {
+      if (Sym->Body) {
+        resolve(S);
+        continue;
+      }
+      Sym->Body = S;
+      S->setBackref(Sym);
+    }
+  }
+  if (!Sym->Body)
+    Sym->Body = New;
+}
+
 template <class ELFT> SymbolBody *SymbolTable<ELFT>::find(StringRef Name) {
-  auto It = Symtab.find(Name);
+  auto It = Symtab.find(SymName(Name));
   if (It == Symtab.end())
     return nullptr;
-  return It->second->Body;
+  return SymVector[It->second]->Body;
 }
 
 template <class ELFT> void SymbolTable<ELFT>::addLazy(Lazy *L) {
@@ -313,6 +432,19 @@ template <class ELFT> void SymbolTable<ELFT>::scanShlibUndefined() {
           Sym->MustBeInDynSym = true;
 }
 
+// Reads the contents of all input sections that are not discarded.
+// This must be called after all object files are added. Files are
+// independent of each other, so this is done in parallel if --threads
+// is given.
+template <class ELFT> void SymbolTable<ELFT>::parseSections() {
+  auto Parse = [&](size_t I) { ObjectFiles[I]->parseSections(); };
+  if (Config->Threads)
+    parallel_for(size_t(0), ObjectFiles.size(), size_t(1), Parse);
+  else
+    for (size_t I = 0, E = ObjectFiles.size(); I != E; ++I)
+      Parse(I);
+}
+
 template class elf::SymbolTable<ELF32LE>;
 template class elf::SymbolTable<ELF32BE>;
 template class elf::SymbolTable<ELF64LE>;
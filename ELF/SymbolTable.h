@@ -12,7 +12,7 @@
 
 #include "InputFiles.h"
 #include "LTO.h"
-#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/DenseMap.h"
 
 namespace lld {
 namespace elf {
@@ -21,6 +21,16 @@ template <class ELFT> class OutputSectionBase;
 struct Symbol;
 class Undefined;
 
+// A symbol name and its hash value. This is used as a key of the symbol
+// table. Symbols carry their name hash, so names of symbols read from
+// files are never hashed again when they are inserted to the table.
+struct SymName {
+  SymName(StringRef Name) : Name(Name), Hash(hashGnu(Name)) {}
+  SymName(StringRef Name, unsigned Hash) : Name(Name), Hash(Hash) {}
+  StringRef Name;
+  unsigned Hash;
+};
+
 // SymbolTable is a bucket of all known symbols, including defined,
 // undefined, or lazy symbols (the last one is symbols in archive
 // files whose archive members are not yet loaded).
@@ -36,12 +46,11 @@ template <class ELFT> class SymbolTable {
   typedef typename ELFT::uint uintX_t;
 
 public:
+  void addFiles(llvm::MutableArrayRef<std::unique_ptr<InputFile>> Files);
   void addFile(std::unique_ptr<InputFile> File);
   void addCombinedLtoObject();
 
-  const llvm::MapVector<StringRef, Symbol *> &getSymbols() const {
-    return Symtab;
-  }
+  ArrayRef<Symbol *> getSymbols() const { return SymVector; }
 
   const std::vector<std::unique_ptr<ObjectFile<ELFT>>> &getObjectFiles() const {
     return ObjectFiles;
@@ -51,6 +60,10 @@ public:
     return SharedFiles;
   }
 
+  const std::vector<std::unique_ptr<BitcodeFile>> &getBitcodeFiles() const {
+    return BitcodeFiles;
+  }
+
   SymbolBody *addUndefined(StringRef Name);
   SymbolBody *addUndefinedOpt(StringRef Name);
   SymbolBody *addAbsolute(StringRef Name, Elf_Sym &ESym);
@@ -59,12 +72,14 @@ public:
   SymbolBody *addIgnored(StringRef Name);
 
   void scanShlibUndefined();
+  void parseSections();
   SymbolBody *find(StringRef Name);
   void wrap(StringRef Name);
   InputFile *findFile(SymbolBody *B);
 
 private:
   Symbol *insert(SymbolBody *New);
+  void importSharedSymbols(Symbol *Sym, SymName Name);
   void addLazy(Lazy *New);
   void addMemberFile(Undefined *Undef, Lazy *L);
   void resolve(SymbolBody *Body);
@@ -73,11 +88,11 @@ private:
   // The order the global symbols are in is not defined. We can use an arbitrary
   // order, but it has to be reproducible. That is true even when cross linking.
   // The default hashing of StringRef produces different results on 32 and 64
-  // bit systems so we use a MapVector. That is arbitrary, deterministic but
-  // a bit inefficient.
-  // FIXME: Experiment with passing in a custom hashing or sorting the symbols
-  // once symbol resolution is finished.
-  llvm::MapVector<StringRef, Symbol *> Symtab;
+  // bit systems, so we never iterate over the hash table. Instead, symbols are
+  // kept in SymVector in insertion order, and the hash table maps names to
+  // indices of the vector.
+  llvm::DenseMap<SymName, unsigned> Symtab;
+  std::vector<Symbol *> SymVector;
   llvm::BumpPtrAllocator Alloc;
 
   // Comdat groups define "link once" sections. If two comdat groups have the
@@ -87,10 +102,15 @@ private:
 
   // The symbol table owns all file objects.
   std::vector<std::unique_ptr<ArchiveFile>> ArchiveFiles;
+  std::vector<std::unique_ptr<LazyObjectFile>> LazyObjectFiles;
   std::vector<std::unique_ptr<ObjectFile<ELFT>>> ObjectFiles;
   std::vector<std::unique_ptr<SharedFile<ELFT>>> SharedFiles;
   std::vector<std::unique_ptr<BitcodeFile>> BitcodeFiles;
 
+  // Shared files whose symbols are looked up on demand, in the order
+  // they were added. See --lazy-shared-symbols.
+  std::vector<SharedFile<ELFT> *> LazySharedFiles;
+
   // Set of .so files to not link the same shared object file more than once.
   llvm::DenseSet<StringRef> SoNames;
 
@@ -100,4 +120,22 @@ private:
 } // namespace elf
 } // namespace lld
 
+namespace llvm {
+template <> struct DenseMapInfo<lld::elf::SymName> {
+  static lld::elf::SymName getEmptyKey() {
+    return lld::elf::SymName(DenseMapInfo<StringRef>::getEmptyKey(), 0);
+  }
+  static lld::elf::SymName getTombstoneKey() {
+    return lld::elf::SymName(DenseMapInfo<StringRef>::getTombstoneKey(), 0);
+  }
+  static unsigned getHashValue(const lld::elf::SymName &Name) {
+    return Name.Hash;
+  }
+  static bool isEqual(const lld::elf::SymName &A, const lld::elf::SymName &B) {
+    return A.Hash == B.Hash &&
+           DenseMapInfo<StringRef>::isEqual(A.Name, B.Name);
+  }
+};
+} // namespace llvm
+
 #endif
@@ -237,14 +237,58 @@ DefinedCommon::DefinedCommon(StringRef N, uint64_t Size, uint64_t Alignment,
               0 /* Type */),
       Alignment(Alignment), Size(Size) {}
 
+Lazy::Lazy(ArchiveFile *F, const Archive::Symbol S)
+    : SymbolBody(LazyKind, S.getName(), false, false, STV_DEFAULT,
+                 /* Type */ 0),
+      File(F), Sym(S) {}
+
+Lazy::Lazy(ArchiveFile *F, StringRef Name, uint32_t NameHash,
+           uint64_t MemberOffset)
+    : SymbolBody(LazyKind, Name, NameHash, false, false, STV_DEFAULT,
+                 /* Type */ 0),
+      File(F), MemberOffset(MemberOffset) {}
+
+Lazy::Lazy(LazyObjectFile *F, StringRef Name)
+    : SymbolBody(LazyKind, Name, false, false, STV_DEFAULT, /* Type */ 0),
+      File(F) {}
+
 std::unique_ptr<InputFile> Lazy::getMember() {
-  MemoryBufferRef MBRef = File->getMember(&Sym);
+  // An object file between --start-lib and --end-lib is read as a whole.
+  if (auto *F = dyn_cast<LazyObjectFile>(File)) {
+    MemoryBufferRef MBRef = F->getBuffer();
+    if (MBRef.getBuffer().empty())
+      return std::unique_ptr<InputFile>(nullptr);
+    return createObjectFile(MBRef);
+  }
+
+  auto *F = cast<ArchiveFile>(File);
+  MemoryBufferRef MBRef = Sym ? F->getMember(Sym.getPointer())
+                             : F->getMemberAt(MemberOffset, getName());
 
   // getMember returns an empty buffer if the member was already
   // read from the library.
   if (MBRef.getBuffer().empty())
     return std::unique_ptr<InputFile>(nullptr);
-  return createObjectFile(MBRef, File->getName());
+  return createObjectFile(MBRef, F->getName());
+}
+
+uint32_t elf::hashGnu(StringRef Name) {
+  uint32_t H = 5381;
+  for (uint8_t C : Name)
+    H = (H << 5) + H + C;
+  return H;
+}
+
+uint32_t elf::hashSysv(StringRef Name) {
+  uint32_t H = 0;
+  for (uint8_t C : Name) {
+    H = (H << 4) + C;
+    uint32_t G = H & 0xf0000000;
+    if (G)
+      H ^= G >> 24;
+    H &= ~G;
+  }
+  return H;
 }
 
 // Returns the demangled C++ symbol name for Name.
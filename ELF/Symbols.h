@@ -18,6 +18,7 @@
 #include "InputSection.h"
 
 #include "lld/Core/LLVM.h"
+#include "llvm/ADT/Optional.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ELF.h"
 
@@ -26,6 +27,7 @@ namespace elf {
 
 class ArchiveFile;
 class InputFile;
+class LazyObjectFile;
 class SymbolBody;
 template <class ELFT> class ObjectFile;
 template <class ELFT> class OutputSection;
@@ -37,6 +39,14 @@ template <class ELFT> class SharedFile;
 // it returns the unmodified string.
 std::string demangle(StringRef Name);
 
+// Returns the hash value of Name as defined by the GNU-style hash table.
+// It is computed once for each symbol and used both by the symbol table
+// and by the .gnu.hash section.
+uint32_t hashGnu(StringRef Name);
+
+// Returns the hash value of Name as defined by the SysV-style hash table.
+uint32_t hashSysv(StringRef Name);
+
 // A real symbol object, SymbolBody, is usually accessed indirectly
 // through a Symbol. There's always one Symbol for each symbol name.
 // The resolver updates SymbolBody pointers as it resolves symbols.
@@ -77,6 +87,7 @@ public:
 
   // Returns the symbol name.
   StringRef getName() const { return Name; }
+  uint32_t getNameHash() const { return NameHash; }
 
   uint8_t getVisibility() const { return Visibility; }
 
@@ -117,8 +128,13 @@ public:
 protected:
   SymbolBody(Kind K, StringRef Name, bool IsWeak, bool IsLocal,
              uint8_t Visibility, uint8_t Type)
+      : SymbolBody(K, Name, hashGnu(Name), IsWeak, IsLocal, Visibility, Type) {}
+
+  SymbolBody(Kind K, StringRef Name, uint32_t NameHash, bool IsWeak,
+             bool IsLocal, uint8_t Visibility, uint8_t Type)
       : SymbolKind(K), IsWeak(IsWeak), IsLocal(IsLocal), Visibility(Visibility),
-        MustBeInDynSym(false), NeedsCopyOrPltAddr(false), Name(Name) {
+        MustBeInDynSym(false), NeedsCopyOrPltAddr(false), NameHash(NameHash),
+        Name(Name) {
     IsFunc = Type == llvm::ELF::STT_FUNC;
     IsTls = Type == llvm::ELF::STT_TLS;
     IsGnuIFunc = Type == llvm::ELF::STT_GNU_IFUNC;
@@ -150,6 +166,7 @@ public:
   unsigned IsGnuIFunc : 1;
 
 protected:
+  uint32_t NameHash;
   StringRef Name;
   Symbol *Backref = nullptr;
 };
@@ -309,10 +326,15 @@ public:
 // the same name, it will ask the Lazy to load a file.
 class Lazy : public SymbolBody {
 public:
-  Lazy(ArchiveFile *F, const llvm::object::Archive::Symbol S)
-      : SymbolBody(LazyKind, S.getName(), false, false, llvm::ELF::STV_DEFAULT,
-                   /* Type */ 0),
-        File(F), Sym(S) {}
+  Lazy(ArchiveFile *F, const llvm::object::Archive::Symbol S);
+
+  // Creates a symbol read from the archive index cache.
+  Lazy(ArchiveFile *F, StringRef Name, uint32_t NameHash,
+       uint64_t MemberOffset);
+
+  // Creates a symbol defined by an object file between --start-lib and
+  // --end-lib.
+  Lazy(LazyObjectFile *F, StringRef Name);
 
   static bool classof(const SymbolBody *S) { return S->kind() == LazyKind; }
 
@@ -323,8 +345,14 @@ public:
   void setWeak() { IsWeak = true; }
 
 private:
-  ArchiveFile *File;
-  const llvm::object::Archive::Symbol Sym;
+  // Either an ArchiveFile or a LazyObjectFile.
+  InputFile *File;
+
+  // The symbol in the archive symbol table. For a symbol read from the
+  // archive index cache, this is none, and MemberOffset is the offset of
+  // the member defining the symbol. Both are unused for LazyObjectFile.
+  llvm::Optional<llvm::object::Archive::Symbol> Sym;
+  uint64_t MemberOffset = 0;
 };
 
 // Some linker-generated symbols need to be created as
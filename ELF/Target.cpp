@@ -17,6 +17,7 @@
 
 #include "Target.h"
 #include "Error.h"
+#include "InputFiles.h"
 #include "OutputSections.h"
 #include "Symbols.h"
 
@@ -65,7 +66,25 @@ template <unsigned N> static void checkAlignment(uint64_t V, uint32_t Type) {
   error("improper alignment for relocation " + S);
 }
 
+template <class ELFT, class TargetT>
+static void relocateSection(const TargetT &T, InputSectionBase<ELFT> &S,
+                            ArrayRef<Relocation<ELFT>> Relocs, uint8_t *Buf,
+                            uint8_t *BufEnd);
+
 namespace {
+// The base class of targets that are used with only one ELF type. It
+// overrides TargetInfo::relocate for that type with the relocation loop
+// instantiated for TargetT. (MipsTargetInfo is a template and overrides
+// relocate itself, so that it does not have a dependent base class.)
+template <class TargetT, class ELFT> class TargetInfoImpl : public TargetInfo {
+public:
+  using TargetInfo::relocate;
+  void relocate(InputSectionBase<ELFT> &S, ArrayRef<Relocation<ELFT>> Rels,
+                uint8_t *Buf, uint8_t *BufEnd) const override {
+    relocateSection(static_cast<const TargetT &>(*this), S, Rels, Buf, BufEnd);
+  }
+};
+
 class AlexTargetInfo : public TargetInfo {
 public:
   AlexTargetInfo();
@@ -73,7 +92,7 @@ public:
                            uint64_t P, uint64_t SA) const;
 };
 
-class X86TargetInfo final : public TargetInfo {
+class X86TargetInfo final : public TargetInfoImpl<X86TargetInfo, ELF32LE> {
 public:
   X86TargetInfo();
   uint64_t getImplicitAddend(uint8_t *Buf, uint32_t Type) const override;
@@ -109,7 +128,8 @@ public:
   bool refersToGotEntry(uint32_t Type) const override;
 };
 
-class X86_64TargetInfo final : public TargetInfo {
+class X86_64TargetInfo final
+    : public TargetInfoImpl<X86_64TargetInfo, ELF64LE> {
 public:
   X86_64TargetInfo();
   uint32_t getDynRel(uint32_t Type) const override;
@@ -131,6 +151,8 @@ public:
                    uint64_t SA) const override;
   bool isRelRelative(uint32_t Type) const override;
   bool isSizeRel(uint32_t Type) const override;
+  bool isLoad(uint32_t Type, ArrayRef<uint8_t> Data,
+              uint64_t Offset) const override;
 
   size_t relaxTlsGdToIe(uint8_t *Loc, uint8_t *BufEnd, uint32_t Type,
                         uint64_t P, uint64_t SA) const override;
@@ -142,7 +164,7 @@ public:
                         uint64_t P, uint64_t SA) const override;
 };
 
-class PPCTargetInfo final : public TargetInfo {
+class PPCTargetInfo final : public TargetInfoImpl<PPCTargetInfo, ELF32BE> {
 public:
   PPCTargetInfo();
   void relocateOne(uint8_t *Loc, uint8_t *BufEnd, uint32_t Type, uint64_t P,
@@ -150,7 +172,7 @@ public:
   bool isRelRelative(uint32_t Type) const override;
 };
 
-class PPC64TargetInfo final : public TargetInfo {
+class PPC64TargetInfo final : public TargetInfoImpl<PPC64TargetInfo, ELF64BE> {
 public:
   PPC64TargetInfo();
   void writePlt(uint8_t *Buf, uint64_t GotEntryAddr, uint64_t PltEntryAddr,
@@ -162,7 +184,8 @@ public:
   bool isRelRelative(uint32_t Type) const override;
 };
 
-class AArch64TargetInfo final : public TargetInfo {
+class AArch64TargetInfo final
+    : public TargetInfoImpl<AArch64TargetInfo, ELF64LE> {
 public:
   AArch64TargetInfo();
   uint32_t getDynRel(uint32_t Type) const override;
@@ -188,7 +211,8 @@ private:
   static const uint64_t TcbSize = 16;
 };
 
-class AMDGPUTargetInfo final : public TargetInfo {
+class AMDGPUTargetInfo final
+    : public TargetInfoImpl<AMDGPUTargetInfo, ELF64LE> {
 public:
   AMDGPUTargetInfo() {}
   void relocateOne(uint8_t *Loc, uint8_t *BufEnd, uint32_t Type, uint64_t P,
@@ -198,6 +222,9 @@ public:
 template <class ELFT> class MipsTargetInfo final : public TargetInfo {
 public:
   MipsTargetInfo();
+  using TargetInfo::relocate;
+  void relocate(InputSectionBase<ELFT> &S, ArrayRef<Relocation<ELFT>> Rels,
+                uint8_t *Buf, uint8_t *BufEnd) const override;
   uint64_t getImplicitAddend(uint8_t *Buf, uint32_t Type) const override;
   uint32_t getDynRel(uint32_t Type) const override;
   void writeGotPlt(uint8_t *Buf, uint64_t Plt) const override;
@@ -247,6 +274,58 @@ TargetInfo *createTarget() {
 
 TargetInfo::~TargetInfo() {}
 
+uint8_t TargetInfo::computeRelFlags(uint32_t Type) const {
+  uint8_t Flags = 0;
+  if (isHintRel(Type))
+    Flags |= RF_Hint;
+  if (isRelRelative(Type))
+    Flags |= RF_RelRelative;
+  if (isSizeRel(Type))
+    Flags |= RF_SizeRel;
+  if (isGotRelative(Type))
+    Flags |= RF_GotRelative;
+  if (pointsToLocalDynamicGotEntry(Type))
+    Flags |= RF_LocalDynamicGot;
+  if (isTlsGlobalDynamicRel(Type))
+    Flags |= RF_TlsGlobalDynamic;
+  if (needsDynRelative(Type))
+    Flags |= RF_DynRelative;
+  return Flags;
+}
+
+// All relocation types defined by the supported psABIs are smaller than
+// 2048 (AArch64 has the largest numbers), so a table of that size covers
+// everything but MIPS64 compound types.
+void TargetInfo::initRelFlags() {
+  RelFlags.resize(2048);
+  for (uint32_t Type = 0, E = RelFlags.size(); Type != E; ++Type)
+    RelFlags[Type] = computeRelFlags(Type);
+}
+
+void TargetInfo::relocate(InputSectionBase<ELF32LE> &S,
+                          ArrayRef<Relocation<ELF32LE>> Rels, uint8_t *Buf,
+                          uint8_t *BufEnd) const {
+  relocateSection(*this, S, Rels, Buf, BufEnd);
+}
+
+void TargetInfo::relocate(InputSectionBase<ELF32BE> &S,
+                          ArrayRef<Relocation<ELF32BE>> Rels, uint8_t *Buf,
+                          uint8_t *BufEnd) const {
+  relocateSection(*this, S, Rels, Buf, BufEnd);
+}
+
+void TargetInfo::relocate(InputSectionBase<ELF64LE> &S,
+                          ArrayRef<Relocation<ELF64LE>> Rels, uint8_t *Buf,
+                          uint8_t *BufEnd) const {
+  relocateSection(*this, S, Rels, Buf, BufEnd);
+}
+
+void TargetInfo::relocate(InputSectionBase<ELF64BE> &S,
+                          ArrayRef<Relocation<ELF64BE>> Rels, uint8_t *Buf,
+                          uint8_t *BufEnd) const {
+  relocateSection(*this, S, Rels, Buf, BufEnd);
+}
+
 uint64_t TargetInfo::getImplicitAddend(uint8_t *Buf, uint32_t Type) const {
   return 0;
 }
@@ -294,6 +373,10 @@ bool TargetInfo::needsCopyRel(uint32_t Type, const SymbolBody &S) const {
 
 bool TargetInfo::isGotRelative(uint32_t Type) const { return false; }
 bool TargetInfo::isHintRel(uint32_t Type) const { return false; }
+bool TargetInfo::isLoad(uint32_t Type, ArrayRef<uint8_t> Data,
+                        uint64_t Offset) const {
+  return false;
+}
 bool TargetInfo::isRelRelative(uint32_t Type) const { return true; }
 bool TargetInfo::isSizeRel(uint32_t Type) const { return false; }
 
@@ -863,6 +946,27 @@ bool X86_64TargetInfo::isSizeRel(uint32_t Type) const {
   return Type == R_X86_64_SIZE32 || Type == R_X86_64_SIZE64;
 }
 
+// Recognizes RIP-relative memory operands of MOV and of the ALU
+// instructions that read them into a register, e.g. "movq foo(%rip), %rax"
+// or "cmpl foo(%rip), %eax". Anything else, such as LEA, is treated as
+// taking the address.
+bool X86_64TargetInfo::isLoad(uint32_t Type, ArrayRef<uint8_t> Data,
+                              uint64_t Offset) const {
+  if (Type != R_X86_64_PC32 || Offset < 2 || Offset > Data.size())
+    return false;
+  // A RIP-relative operand is encoded as ModRM with mod=00 and r/m=101,
+  // directly followed by the displacement. Two-byte opcodes (0x0F xx)
+  // include stores such as MOVLPS, so they are not recognized.
+  if (Offset >= 3 && Data[Offset - 3] == 0x0f)
+    return false;
+  uint8_t Op = Data[Offset - 2];
+  uint8_t ModRM = Data[Offset - 1];
+  if ((ModRM & 0xc7) != 0x05)
+    return false;
+  // MOV r, r/m, or ADD, OR, ADC, SBB, AND, SUB, XOR, CMP r, r/m.
+  return Op == 0x8b || (Op < 0x40 && (Op & 0x7) == 0x3);
+}
+
 // "Ulrich Drepper, ELF Handling For Thread-Local Storage" (5.5
 // x86-x64 linker optimizations, http://www.akkadia.org/drepper/tls.pdf) shows
 // how GD can be optimized to LE:
@@ -1616,6 +1720,13 @@ void AMDGPUTargetInfo::relocateOne(uint8_t *Loc, uint8_t *BufEnd, uint32_t Type,
   llvm_unreachable("not implemented");
 }
 
+template <class ELFT>
+void MipsTargetInfo<ELFT>::relocate(InputSectionBase<ELFT> &S,
+                                    ArrayRef<Relocation<ELFT>> Rels,
+                                    uint8_t *Buf, uint8_t *BufEnd) const {
+  relocateSection(*this, S, Rels, Buf, BufEnd);
+}
+
 template <class ELFT> MipsTargetInfo<ELFT>::MipsTargetInfo() {
   GotHeaderEntriesNum = 2;
   GotPltHeaderEntriesNum = 2;
@@ -1896,6 +2007,186 @@ bool MipsTargetInfo<ELFT>::isRelRelative(uint32_t Type) const {
   }
 }
 
+static uint32_t getMipsPairType(uint32_t Type, const SymbolBody &Sym) {
+  switch (Type) {
+  case R_MIPS_HI16:
+    return R_MIPS_LO16;
+  case R_MIPS_GOT16:
+    return Sym.isLocal() ? R_MIPS_LO16 : R_MIPS_NONE;
+  case R_MIPS_PCHI16:
+    return R_MIPS_PCLO16;
+  case R_MICROMIPS_HI16:
+    return R_MICROMIPS_LO16;
+  default:
+    return R_MIPS_NONE;
+  }
+}
+
+template <class ELFT>
+static int32_t findMipsPairedAddend(InputSectionBase<ELFT> &S, uint8_t *Buf,
+                                    uint8_t *BufLoc, SymbolBody &Sym,
+                                    const Relocation<ELFT> *Rel,
+                                    const Relocation<ELFT> *End) {
+  typedef typename ELFT::uint uintX_t;
+  uint32_t Type = getMipsPairType(Rel->Type, Sym);
+
+  // Some MIPS relocations use addend calculated from addend of the relocation
+  // itself and addend of paired relocation. ABI requires to compute such
+  // combined addend in case of REL relocation record format only.
+  // See p. 4-17 at ftp://www.linux-mips.org/pub/linux/mips/doc/ABI/mipsabi.pdf
+  if (S.AreRelocsRela || Type == R_MIPS_NONE)
+    return 0;
+
+  for (const Relocation<ELFT> *RI = Rel; RI != End; ++RI) {
+    if (RI->Type != Type)
+      continue;
+    if (RI->Sym != Rel->Sym)
+      continue;
+    uintX_t Offset = S.getOffset(RI->Offset);
+    if (Offset == (uintX_t)-1)
+      break;
+    const endianness E = ELFT::TargetEndianness;
+    return ((read32<E>(BufLoc) & 0xffff) << 16) +
+           readSignedLo16<E>(Buf + Offset);
+  }
+  StringRef OldName = getELFRelocationTypeName(Config->EMachine, Rel->Type);
+  StringRef NewName = getELFRelocationTypeName(Config->EMachine, Type);
+  warning("can't find matching " + NewName + " relocation for " + OldName);
+  return 0;
+}
+
+template <class ELFT, class uintX_t>
+static uintX_t adjustMipsSymVA(uint32_t Type, const elf::ObjectFile<ELFT> &File,
+                               const SymbolBody &Body, uintX_t AddrLoc,
+                               uintX_t SymVA) {
+  if (Type == R_MIPS_HI16 && &Body == Config->MipsGpDisp)
+    return getMipsGpAddr<ELFT>() - AddrLoc;
+  if (Type == R_MIPS_LO16 && &Body == Config->MipsGpDisp)
+    return getMipsGpAddr<ELFT>() - AddrLoc + 4;
+  if (&Body == Config->MipsLocalGp)
+    return getMipsGpAddr<ELFT>();
+  if (Body.isLocal() && (Type == R_MIPS_GPREL16 || Type == R_MIPS_GPREL32))
+    // We need to adjust SymVA value in case of R_MIPS_GPREL16/32
+    // relocations because they use the following expression to calculate
+    // the relocation's result for local symbol: S + A + GP0 - G.
+    return SymVA + File.getMipsGp0();
+  return SymVA;
+}
+
+template <class ELFT, class uintX_t>
+static uintX_t getMipsGotVA(const SymbolBody &Body, uintX_t SymVA,
+                            uint8_t *BufLoc) {
+  if (Body.isLocal())
+    // If relocation against MIPS local symbol requires GOT entry, this entry
+    // should be initialized by 'page address'. This address is high 16-bits
+    // of sum the symbol's value and the addend.
+    return Out<ELFT>::Got->getMipsLocalPageAddr(SymVA);
+  if (!Body.isPreemptible())
+    // For non-local symbols GOT entries should contain their full
+    // addresses. But if such symbol cannot be preempted, we do not
+    // have to put them into the "global" part of GOT and use dynamic
+    // linker to determine their actual addresses. That is why we
+    // create GOT entries for them in the "local" part of GOT.
+    return Out<ELFT>::Got->getMipsLocalFullAddr(Body);
+  return Body.getGotVA<ELFT>();
+}
+
+// The relocation loop. TargetInfo::relocate() instantiates this for
+// TargetInfo, and TargetInfoImpl and MipsTargetInfo for each target class.
+// Target classes are final, so in the latter the calls to T below are
+// direct calls that the compiler can inline, rather than virtual calls for
+// every relocation.
+template <class ELFT, class TargetT>
+static void relocateSection(const TargetT &T, InputSectionBase<ELFT> &S,
+                            ArrayRef<Relocation<ELFT>> Relocs, uint8_t *Buf,
+                            uint8_t *BufEnd) {
+  typedef typename ELFT::uint uintX_t;
+  const Relocation<ELFT> *Rels = Relocs.data();
+  size_t Num = Relocs.size();
+  uintX_t SecVA = S.OutSec->getVA();
+  for (size_t I = 0; I < Num; ++I) {
+    const Relocation<ELFT> &RI = Rels[I];
+    uintX_t Offset = S.getOffset(RI.Offset);
+    if (Offset == (uintX_t)-1)
+      continue;
+
+    uintX_t A = RI.Addend;
+    uint32_t Type = RI.Type;
+    uint8_t *BufLoc = Buf + Offset;
+    uintX_t AddrLoc = SecVA + Offset;
+
+    if (T.hasRelFlag(Type, TargetInfo::RF_LocalDynamicGot) &&
+        !T.canRelaxTls(Type, nullptr)) {
+      T.relocateOne(BufLoc, BufEnd, Type, AddrLoc,
+                    Out<ELFT>::Got->getTlsIndexVA() + A);
+      continue;
+    }
+
+    SymbolBody &Body = RI.Sym->repl();
+
+    if (T.canRelaxTls(Type, &Body)) {
+      uintX_t SymVA;
+      if (T.needsGot(Type, Body))
+        SymVA = Body.getGotVA<ELFT>();
+      else
+        SymVA = Body.getVA<ELFT>();
+      // By optimizing TLS relocations, it is sometimes needed to skip
+      // relocations that immediately follow TLS relocations. This function
+      // knows how many slots we need to skip.
+      I += T.relaxTls(BufLoc, BufEnd, Type, AddrLoc, SymVA, Body);
+      continue;
+    }
+
+    // PPC64 has a special relocation representing the TOC base pointer
+    // that does not have a corresponding symbol.
+    if (Config->EMachine == EM_PPC64 && Type == R_PPC64_TOC) {
+      uintX_t SymVA = getPPC64TocBase() + A;
+      T.relocateOne(BufLoc, BufEnd, Type, AddrLoc, SymVA);
+      continue;
+    }
+
+    if (T.hasRelFlag(Type, TargetInfo::RF_TlsGlobalDynamic) &&
+        !T.canRelaxTls(Type, &Body)) {
+      T.relocateOne(BufLoc, BufEnd, Type, AddrLoc,
+                    Out<ELFT>::Got->getGlobalDynAddr(Body) + A);
+      continue;
+    }
+
+    if (!S.AreRelocsRela)
+      A += T.getImplicitAddend(BufLoc, Type);
+    if (Config->EMachine == EM_MIPS)
+      A += findMipsPairedAddend(S, Buf, BufLoc, Body, &RI, Rels + Num);
+    uintX_t SymVA = Body.getVA<ELFT>(A);
+
+    if (T.needsPlt(Type, Body)) {
+      SymVA = Body.getPltVA<ELFT>() + A;
+    } else if (T.needsGot(Type, Body)) {
+      if (Config->EMachine == EM_MIPS)
+        SymVA = getMipsGotVA<ELFT>(Body, SymVA, BufLoc);
+      else
+        SymVA = Body.getGotVA<ELFT>() + A;
+      if (Body.IsTls)
+        Type = T.getTlsGotRel(Type);
+    } else if (T.hasRelFlag(Type, TargetInfo::RF_SizeRel) &&
+               Body.isPreemptible()) {
+      // A SIZE relocation is supposed to set a symbol size, but if a symbol
+      // can be preempted, the size at runtime may be different than link time.
+      // If that's the case, we leave the field alone rather than filling it
+      // with a possibly incorrect value.
+      continue;
+    } else if (Config->EMachine == EM_MIPS) {
+      SymVA = adjustMipsSymVA<ELFT>(Type, *S.getFile(), Body, AddrLoc, SymVA);
+    } else if (!T.template needsCopyRel<ELFT>(Type, Body) &&
+               Body.isPreemptible()) {
+      continue;
+    }
+    if (T.hasRelFlag(Type, TargetInfo::RF_SizeRel))
+      SymVA = Body.getSize<ELFT>() + A;
+
+    T.relocateOne(BufLoc, BufEnd, Type, AddrLoc, SymVA);
+  }
+}
+
 // _gp is a MIPS-specific ABI-defined symbol which points to
 // a location that is relative to GOT. This function returns
 // the value for the symbol.
@@ -14,9 +14,12 @@
 #include "llvm/Object/ELF.h"
 
 #include <memory>
+#include <vector>
 
 namespace lld {
 namespace elf {
+template <class ELFT> class InputSectionBase;
+template <class ELFT> struct Relocation;
 class SymbolBody;
 
 class TargetInfo {
@@ -65,6 +68,12 @@ public:
   virtual void relocateOne(uint8_t *Loc, uint8_t *BufEnd, uint32_t Type,
                            uint64_t P, uint64_t SA) const = 0;
   virtual bool isGotRelative(uint32_t Type) const;
+
+  // Returns true if a relocation of type Type at Offset in code section
+  // contents Data belongs to an instruction that only reads memory at the
+  // target, as opposed to one that may take the target's address.
+  virtual bool isLoad(uint32_t Type, llvm::ArrayRef<uint8_t> Data,
+                      uint64_t Offset) const;
   bool canRelaxTls(uint32_t Type, const SymbolBody *S) const;
   template <class ELFT>
   bool needsCopyRel(uint32_t Type, const SymbolBody &S) const;
@@ -72,6 +81,49 @@ public:
                   uint64_t SA, const SymbolBody &S) const;
   virtual ~TargetInfo();
 
+  // Applies relocations Rels to the contents of S in Buf. Each target
+  // overrides the function for its ELF type with a copy of the relocation
+  // loop specialized for the target, so that relocateOne(), needsGot(),
+  // needsPlt() and so on are not virtual calls for each relocation.
+  virtual void
+  relocate(InputSectionBase<llvm::object::ELF32LE> &S,
+           llvm::ArrayRef<Relocation<llvm::object::ELF32LE>> Rels,
+           uint8_t *Buf, uint8_t *BufEnd) const;
+  virtual void
+  relocate(InputSectionBase<llvm::object::ELF32BE> &S,
+           llvm::ArrayRef<Relocation<llvm::object::ELF32BE>> Rels,
+           uint8_t *Buf, uint8_t *BufEnd) const;
+  virtual void
+  relocate(InputSectionBase<llvm::object::ELF64LE> &S,
+           llvm::ArrayRef<Relocation<llvm::object::ELF64LE>> Rels,
+           uint8_t *Buf, uint8_t *BufEnd) const;
+  virtual void
+  relocate(InputSectionBase<llvm::object::ELF64BE> &S,
+           llvm::ArrayRef<Relocation<llvm::object::ELF64BE>> Rels,
+           uint8_t *Buf, uint8_t *BufEnd) const;
+
+  // Properties of relocation types that depend only on the type and not on
+  // the target symbol. initRelFlags() computes them once per link from the
+  // predicates above, so that loops over relocations can test them with a
+  // table lookup instead of a series of virtual calls.
+  enum RelFlag : uint8_t {
+    RF_Hint = 1 << 0,
+    RF_RelRelative = 1 << 1,
+    RF_SizeRel = 1 << 2,
+    RF_GotRelative = 1 << 3,
+    RF_LocalDynamicGot = 1 << 4,
+    RF_TlsGlobalDynamic = 1 << 5,
+    RF_DynRelative = 1 << 6,
+  };
+
+  void initRelFlags();
+
+  bool hasRelFlag(uint32_t Type, RelFlag Flag) const {
+    if (Type < RelFlags.size())
+      return RelFlags[Type] & Flag;
+    return computeRelFlags(Type) & Flag;
+  }
+
   unsigned PageSize = 4096;
 
   // On freebsd x86_64 the first page cannot be mmaped.
@@ -97,6 +149,12 @@ public:
   bool UseLazyBinding = false;
 
 private:
+  uint8_t computeRelFlags(uint32_t Type) const;
+
+  // Indexed by relocation type. Types that do not fit (e.g. MIPS64
+  // compound types) are classified on demand by computeRelFlags().
+  std::vector<uint8_t> RelFlags;
+
   virtual bool needsCopyRelImpl(uint32_t Type) const;
   virtual bool needsPltImpl(uint32_t Type) const;
 
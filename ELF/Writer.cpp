@@ -14,6 +14,7 @@
 #include "SymbolTable.h"
 #include "Target.h"
 
+#include "lld/Core/Parallel.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringSwitch.h"
@@ -62,12 +63,16 @@ private:
   void addPredefinedSections();
   bool needsGot();
 
-  template <class RelTy>
-  void scanRelocs(InputSectionBase<ELFT> &C,
-                  iterator_range<const RelTy *> Rels);
+  // A section whose relocations are scanned by scanRelocs(). If Filtered
+  // is true, only the relocations at indices in Relocs need to be scanned.
+  struct RelocScan {
+    InputSectionBase<ELFT> *Sec;
+    bool Filtered;
+    std::vector<uint32_t> Relocs;
+  };
 
-  void scanRelocs(InputSection<ELFT> &C);
-  void scanRelocs(InputSectionBase<ELFT> &S, const Elf_Shdr &RelSec);
+  void scanRelocs(InputSectionBase<ELFT> &C,
+                  const std::vector<uint32_t> *Filter);
   void createPhdrs();
   void assignAddresses();
   void assignAddressesRelocatable();
@@ -151,8 +156,16 @@ template <class ELFT> void elf::writeResult(SymbolTable<ELFT> *Symtab) {
   std::unique_ptr<SymbolTableSection<ELFT>> SymTabSec;
   std::unique_ptr<OutputSection<ELFT>> MipsRldMap;
 
-  if (Config->BuildId)
-    BuildId.reset(new BuildIdSection<ELFT>);
+  if (Config->BuildId == BuildIdKind::Fnv1)
+    BuildId.reset(new BuildIdFnv1<ELFT>);
+  else if (Config->BuildId == BuildIdKind::Md5)
+    BuildId.reset(new BuildIdMd5<ELFT>);
+  else if (Config->BuildId == BuildIdKind::Sha1)
+    BuildId.reset(new BuildIdSha1<ELFT>);
+  else if (Config->BuildId == BuildIdKind::Uuid)
+    BuildId.reset(new BuildIdUuid<ELFT>);
+  else if (Config->BuildId == BuildIdKind::Hexstring)
+    BuildId.reset(new BuildIdHexstring<ELFT>);
   if (Config->GnuHash)
     GnuHashTab.reset(new GnuHashTableSection<ELFT>);
   if (Config->SysvHash)
@@ -261,10 +274,9 @@ template <bool Is64Bits> struct DenseMapInfo<SectionKey<Is64Bits>> {
 }
 
 // Returns the number of relocations processed.
-template <class ELFT, class RelT>
-static unsigned handleTlsRelocation(uint32_t Type, SymbolBody &Body,
-                                    InputSectionBase<ELFT> &C, RelT &RI) {
-  if (Target->pointsToLocalDynamicGotEntry(Type)) {
+template <class ELFT>
+static unsigned handleTlsRelocation(uint32_t Type, SymbolBody &Body) {
+  if (Target->hasRelFlag(Type, TargetInfo::RF_LocalDynamicGot)) {
     if (Target->canRelaxTls(Type, nullptr))
       return 1;
     if (Out<ELFT>::Got->addTlsIndex())
@@ -277,7 +289,7 @@ static unsigned handleTlsRelocation(uint32_t Type, SymbolBody &Body,
   if (!Body.IsTls)
     return 0;
 
-  if (Target->isTlsGlobalDynamicRel(Type)) {
+  if (Target->hasRelFlag(Type, TargetInfo::RF_TlsGlobalDynamic)) {
     if (!Target->canRelaxTls(Type, &Body)) {
       if (Out<ELFT>::Got->addDynTlsEntry(Body)) {
         Out<ELFT>::RelaDyn->addReloc({Target->TlsModuleIndexRel,
@@ -312,22 +324,21 @@ static unsigned handleTlsRelocation(uint32_t Type, SymbolBody &Body,
 // complicates things for the dynamic linker and means we would have to reserve
 // space for the extra PT_LOAD even if we end up not using it.
 template <class ELFT>
-template <class RelTy>
 void Writer<ELFT>::scanRelocs(InputSectionBase<ELFT> &C,
-                              iterator_range<const RelTy *> Rels) {
-  const elf::ObjectFile<ELFT> &File = *C.getFile();
-  for (auto I = Rels.begin(), E = Rels.end(); I != E; ++I) {
-    const RelTy &RI = *I;
-    uint32_t SymIndex = RI.getSymbol(Config->Mips64EL);
-    SymbolBody &OrigBody = File.getSymbolBody(SymIndex);
+                              const std::vector<uint32_t> *Filter) {
+  const Relocation<ELFT> *Begin = C.Relocations.data();
+  size_t N = Filter ? Filter->size() : C.Relocations.size();
+  for (size_t I = 0; I != N; ++I) {
+    const Relocation<ELFT> &RI = Begin[Filter ? (*Filter)[I] : I];
+    SymbolBody &OrigBody = *RI.Sym;
     SymbolBody &Body = OrigBody.repl();
-    uint32_t Type = RI.getType(Config->Mips64EL);
+    uint32_t Type = RI.Type;
 
     // Ignore "hint" relocation because it is for optional code optimization.
-    if (Target->isHintRel(Type))
+    if (Target->hasRelFlag(Type, TargetInfo::RF_Hint))
       continue;
 
-    if (Target->isGotRelative(Type))
+    if (Target->hasRelFlag(Type, TargetInfo::RF_GotRelative))
       HasGotOffRel = true;
 
     // Set "used" bit for --as-needed.
@@ -336,14 +347,14 @@ void Writer<ELFT>::scanRelocs(InputSectionBase<ELFT> &C,
         S->File->IsUsed = true;
 
     bool Preemptible = Body.isPreemptible();
-    if (unsigned Processed = handleTlsRelocation<ELFT>(Type, Body, C, RI)) {
+    if (unsigned Processed = handleTlsRelocation<ELFT>(Type, Body)) {
       I += (Processed - 1);
       continue;
     }
 
-    if (Target->needsDynRelative(Type))
-      Out<ELFT>::RelaDyn->addReloc({Target->RelativeRel, &C, RI.r_offset, true,
-                                    &Body, getAddend<ELFT>(RI)});
+    if (Target->hasRelFlag(Type, TargetInfo::RF_DynRelative))
+      Out<ELFT>::RelaDyn->addReloc(
+          {Target->RelativeRel, &C, RI.Offset, true, &Body, RI.Addend});
 
     // If a symbol in a DSO is referenced directly instead of through GOT,
     // we need to create a copy relocation for the symbol.
@@ -417,8 +428,9 @@ void Writer<ELFT>::scanRelocs(InputSectionBase<ELFT> &C,
         // ftp://www.linux-mips.org/pub/linux/mips/doc/ABI/mipsabi.pdf
         continue;
 
-      bool Dynrel = Config->Pic && !Target->isRelRelative(Type) &&
-                    !Target->isSizeRel(Type);
+      bool Dynrel = Config->Pic &&
+                    !Target->hasRelFlag(Type, TargetInfo::RF_RelRelative) &&
+                    !Target->hasRelFlag(Type, TargetInfo::RF_SizeRel);
       if (Preemptible || Dynrel) {
         uint32_t DynType;
         if (Body.IsTls)
@@ -454,8 +466,8 @@ void Writer<ELFT>::scanRelocs(InputSectionBase<ELFT> &C,
     if (Preemptible) {
       // We don't know anything about the finaly symbol. Just ask the dynamic
       // linker to handle the relocation for us.
-      Out<ELFT>::RelaDyn->addReloc({Target->getDynRel(Type), &C, RI.r_offset,
-                                    false, &Body, getAddend<ELFT>(RI)});
+      Out<ELFT>::RelaDyn->addReloc({Target->getDynRel(Type), &C, RI.Offset,
+                                    false, &Body, RI.Addend});
       continue;
     }
 
@@ -466,35 +478,59 @@ void Writer<ELFT>::scanRelocs(InputSectionBase<ELFT> &C,
     // We can however do better than just copying the incoming relocation. We
     // can process some of it and and just ask the dynamic linker to add the
     // load address.
-    if (!Config->Pic || Target->isRelRelative(Type) || Target->isSizeRel(Type))
+    if (!Config->Pic || Target->hasRelFlag(Type, TargetInfo::RF_RelRelative) ||
+        Target->hasRelFlag(Type, TargetInfo::RF_SizeRel))
       continue;
 
-    uintX_t Addend = getAddend<ELFT>(RI);
-    if (Config->EMachine == EM_PPC64 && RI.getType(false) == R_PPC64_TOC) {
-      Out<ELFT>::RelaDyn->addReloc({R_PPC64_RELATIVE, &C, RI.r_offset, false,
+    uintX_t Addend = RI.Addend;
+    if (Config->EMachine == EM_PPC64 && Type == R_PPC64_TOC) {
+      Out<ELFT>::RelaDyn->addReloc({R_PPC64_RELATIVE, &C, RI.Offset, false,
                                     nullptr,
                                     (uintX_t)getPPC64TocBase() + Addend});
       continue;
     }
     Out<ELFT>::RelaDyn->addReloc(
-        {Target->RelativeRel, &C, RI.r_offset, true, &Body, Addend});
+        {Target->RelativeRel, &C, RI.Offset, true, &Body, Addend});
   }
 }
 
-template <class ELFT> void Writer<ELFT>::scanRelocs(InputSection<ELFT> &C) {
-  if (C.getSectionHdr()->sh_flags & SHF_ALLOC)
-    for (const Elf_Shdr *RelSec : C.RelocSections)
-      scanRelocs(C, *RelSec);
+// Returns true if scanRelocs() may need to do something for a relocation,
+// such as creating a GOT or PLT entry or a dynamic relocation. Unlike
+// scanRelocs(), this function does not depend on the results for other
+// relocations, so it can be called for many sections in parallel.
+static bool needsScan(uint32_t Type, SymbolBody &Body) {
+  if (Target->hasRelFlag(Type, TargetInfo::RF_Hint))
+    return false;
+  if (Config->EMachine == EM_MIPS)
+    return true;
+  if (Body.isShared() || Body.IsGnuIFunc || Body.IsTls || Body.isPreemptible())
+    return true;
+  if (Target->hasRelFlag(Type, TargetInfo::RF_GotRelative) ||
+      Target->hasRelFlag(Type, TargetInfo::RF_LocalDynamicGot) ||
+      Target->hasRelFlag(Type, TargetInfo::RF_DynRelative))
+    return true;
+  if (Target->needsPlt(Type, Body) || Target->needsGot(Type, Body))
+    return true;
+  return Config->Pic && !Target->hasRelFlag(Type, TargetInfo::RF_RelRelative) &&
+         !Target->hasRelFlag(Type, TargetInfo::RF_SizeRel);
 }
 
+// Returns indices of relocations for which needsScan() is true.
 template <class ELFT>
-void Writer<ELFT>::scanRelocs(InputSectionBase<ELFT> &S,
-                              const Elf_Shdr &RelSec) {
-  ELFFile<ELFT> &EObj = S.getFile()->getObj();
-  if (RelSec.sh_type == SHT_RELA)
-    scanRelocs(S, EObj.relas(&RelSec));
-  else
-    scanRelocs(S, EObj.rels(&RelSec));
+static std::vector<uint32_t> findRelocsToScan(InputSectionBase<ELFT> &S) {
+  std::vector<uint32_t> V;
+  bool KeepNext = false;
+  for (uint32_t I = 0, E = S.Relocations.size(); I != E; ++I) {
+    const Relocation<ELFT> &RI = S.Relocations[I];
+    SymbolBody &Body = RI.Sym->repl();
+    bool Keep = KeepNext || needsScan(RI.Type, Body);
+    if (Keep)
+      V.push_back(I);
+    // A TLS relocation and the following one may be processed as a pair
+    // (see handleTlsRelocation), so the following one is kept as well.
+    KeepNext = Keep && Body.IsTls;
+  }
+  return V;
 }
 
 template <class ELFT>
@@ -987,6 +1023,10 @@ template <class ELFT> bool Writer<ELFT>::createSections() {
     }
   }
 
+  for (OutputSectionBase<ELFT> *Sec : RegularSections)
+    if (auto *OS = dyn_cast<OutputSection<ELFT>>(Sec))
+      OS->assignOffsets();
+
   Out<ELFT>::Bss = static_cast<OutputSection<ELFT> *>(
       Factory.lookup(".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE));
 
@@ -1029,25 +1069,38 @@ template <class ELFT> bool Writer<ELFT>::createSections() {
 
   // Scan relocations. This must be done after every symbol is declared so that
   // we can correctly decide if a dynamic relocation is needed.
+  std::vector<RelocScan> Scans;
   for (const std::unique_ptr<elf::ObjectFile<ELFT>> &F :
        Symtab.getObjectFiles()) {
     for (InputSectionBase<ELFT> *C : F->getSections()) {
       if (isDiscarded(C))
         continue;
-      if (auto *S = dyn_cast<InputSection<ELFT>>(C))
-        scanRelocs(*S);
-      else if (auto *S = dyn_cast<EHInputSection<ELFT>>(C))
-        if (S->RelocSection)
-          scanRelocs(*S, *S->RelocSection);
+      if (C->Relocations.empty())
+        continue;
+      if (isa<EHInputSection<ELFT>>(C) ||
+          (isa<InputSection<ELFT>>(C) &&
+           (C->getSectionHdr()->sh_flags & SHF_ALLOC)))
+        Scans.push_back({C, false, {}});
     }
   }
 
+  // Most relocations need neither GOT/PLT entries nor dynamic relocations.
+  // Scanning has to be done serially in a fixed order to make the output
+  // deterministic, so we find relocations that need it in parallel first.
+  if (Config->Threads)
+    parallel_for(size_t(0), Scans.size(), size_t(16), [&](size_t I) {
+      Scans[I].Relocs = findRelocsToScan(*Scans[I].Sec);
+      Scans[I].Filtered = true;
+    });
+  for (RelocScan &R : Scans)
+    scanRelocs(*R.Sec, R.Filtered ? &R.Relocs : nullptr);
+
   // Now that we have defined all possible symbols including linker-
   // synthesized ones. Visit all symbols to give the finishing touches.
   std::vector<DefinedCommon *> CommonSymbols;
   std::vector<SharedSymbol<ELFT> *> CopyRelSymbols;
-  for (auto &P : Symtab.getSymbols()) {
-    SymbolBody *Body = P.second->Body;
+  for (Symbol *S : Symtab.getSymbols()) {
+    SymbolBody *Body = S->Body;
     if (auto *U = dyn_cast<Undefined>(Body))
       if (!U->isWeak() && !U->canKeepUndefined())
         reportUndefined<ELFT>(Symtab, Body);
@@ -1487,16 +1540,20 @@ template <class ELFT> void Writer<ELFT>::writeHeader() {
   uint8_t *Buf = Buffer->getBufferStart();
   memcpy(Buf, "\177ELF", 4);
 
-  auto &FirstObj = cast<ELFFileBase<ELFT>>(*Config->FirstElf);
+  // FirstElf is null if all input files are lazy object files that
+  // were not loaded. Config->EMachine is set in any case.
+  uint8_t OSABI = ELFOSABI_NONE;
+  if (Config->FirstElf)
+    OSABI = cast<ELFFileBase<ELFT>>(Config->FirstElf)->getOSABI();
 
   // Write the ELF header.
   auto *EHdr = reinterpret_cast<Elf_Ehdr *>(Buf);
   EHdr->e_ident[EI_CLASS] = ELFT::Is64Bits ? ELFCLASS64 : ELFCLASS32;
   EHdr->e_ident[EI_DATA] = getELFEncoding<ELFT>();
   EHdr->e_ident[EI_VERSION] = EV_CURRENT;
-  EHdr->e_ident[EI_OSABI] = FirstObj.getOSABI();
+  EHdr->e_ident[EI_OSABI] = OSABI;
   EHdr->e_type = getELFType();
-  EHdr->e_machine = FirstObj.getEMachine();
+  EHdr->e_machine = Config->EMachine;
   EHdr->e_version = EV_CURRENT;
   EHdr->e_entry = getEntryAddr<ELFT>();
   EHdr->e_shoff = SectionHeaderOff;
@@ -1548,9 +1605,46 @@ template <class ELFT> void Writer<ELFT>::writeSections() {
     Sec->writeTo(Buf + Sec->getFileOff());
   }
 
+  // .eh_frame_hdr is created from the contents of .eh_frame, and offsets
+  // of .eh_frame pieces are fixed when .eh_frame is written, so .eh_frame
+  // has to be written before any other section.
+  // .eh_frame_hdr is written next on this thread because its writeTo
+  // uses the thread pool itself.
   for (OutputSectionBase<ELFT> *Sec : OutputSections)
-    if (Sec != Out<ELFT>::Opd)
+    if (isa<EHOutputSection<ELFT>>(Sec))
       Sec->writeTo(Buf + Sec->getFileOff());
+  for (OutputSectionBase<ELFT> *Sec : OutputSections)
+    if (Sec == Out<ELFT>::EhFrameHdr)
+      Sec->writeTo(Buf + Sec->getFileOff());
+
+  // The remaining sections are independent of each other, except that
+  // MIPS local GOT entries are created while regular sections are
+  // relocated, so .got is written last. If --threads is given, sections
+  // other than regular output sections are written by the thread pool.
+  // Regular output sections are written on this thread, since
+  // OutputSection::writeTo itself uses the thread pool, and waiting for
+  // it from a thread in the pool could deadlock.
+  auto IsWrittenSeparately = [](OutputSectionBase<ELFT> *Sec) {
+    return Sec == Out<ELFT>::Opd || Sec == Out<ELFT>::EhFrameHdr ||
+           Sec == Out<ELFT>::Got || isa<EHOutputSection<ELFT>>(Sec);
+  };
+  TaskGroup Tasks;
+  for (OutputSectionBase<ELFT> *Sec : OutputSections) {
+    if (IsWrittenSeparately(Sec))
+      continue;
+    if (Config->Threads && !isa<OutputSection<ELFT>>(Sec))
+      Tasks.spawn([=] { Sec->writeTo(Buf + Sec->getFileOff()); });
+  }
+  for (OutputSectionBase<ELFT> *Sec : OutputSections) {
+    if (IsWrittenSeparately(Sec))
+      continue;
+    if (!Config->Threads || isa<OutputSection<ELFT>>(Sec))
+      Sec->writeTo(Buf + Sec->getFileOff());
+  }
+  for (OutputSectionBase<ELFT> *Sec : OutputSections)
+    if (Sec == Out<ELFT>::Got)
+      Sec->writeTo(Buf + Sec->getFileOff());
+  Tasks.sync();
 }
 
 template <class ELFT> void Writer<ELFT>::writeBuildId() {
@@ -1558,22 +1652,26 @@ template <class ELFT> void Writer<ELFT>::writeBuildId() {
   if (!S)
     return;
 
-  // Compute a hash of all sections except .debug_* sections.
-  // We skip debug sections because they tend to be very large
-  // and their contents are very likely to be the same as long as
-  // other sections are the same.
+  // Compute a hash of the output file. Unless --build-id-debug is given,
+  // .debug_* sections are excluded because they tend to be very large
+  // and their contents are very likely to be the same as long as other
+  // sections are the same.
   uint8_t *Start = Buffer->getBufferStart();
   uint8_t *Last = Start;
-  for (OutputSectionBase<ELFT> *Sec : OutputSections) {
-    uint8_t *End = Start + Sec->getFileOff();
-    if (!Sec->getName().startswith(".debug_"))
-      S->update({Last, End});
-    Last = End;
+  std::vector<ArrayRef<uint8_t>> Regions;
+  if (!Config->BuildIdDebug) {
+    for (OutputSectionBase<ELFT> *Sec : OutputSections) {
+      if (!Sec->getName().startswith(".debug_"))
+        continue;
+      uint8_t *Begin = Start + Sec->getFileOff();
+      Regions.push_back({Last, Begin});
+      Last = Begin + Sec->getSize();
+    }
   }
-  S->update({Last, Start + FileSize});
+  Regions.push_back({Last, Start + FileSize});
 
   // Fill the hash value field in the .note.gnu.build-id section.
-  S->writeBuildId();
+  S->writeBuildId(Regions);
 }
 
 template void elf::writeResult<ELF32LE>(SymbolTable<ELF32LE> *Symtab);
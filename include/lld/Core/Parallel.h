@@ -12,14 +12,20 @@
 
 #include "lld/Core/Instrumentation.h"
 #include "lld/Core/LLVM.h"
+#include "llvm/Support/Compiler.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/thread.h"
 
 #include <algorithm>
 #include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <mutex>
-#include <stack>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 #if defined(_MSC_VER) && LLVM_ENABLE_THREADS
 #include <concrt.h>
@@ -35,7 +41,7 @@ namespace lld {
 ///
 /// Calling dec() on a Latch with a count of 0 has undefined behaivor.
 class Latch {
-  uint32_t _count;
+  std::atomic<uint32_t> _count;
   mutable std::mutex _condMut;
   mutable std::condition_variable _cond;
 
@@ -43,21 +49,30 @@ public:
   explicit Latch(uint32_t count = 0) : _count(count) {}
   ~Latch() { sync(); }
 
-  void inc() {
-    std::unique_lock<std::mutex> lock(_condMut);
-    ++_count;
-  }
+  void inc() { _count.fetch_add(1, std::memory_order_relaxed); }
 
   void dec() {
+    // Decrements that cannot reach zero need no lock. The last one is done
+    // under the lock, so that sync() cannot return and let the owner destroy
+    // this latch while dec() is still using it.
+    uint32_t count = _count.load(std::memory_order_relaxed);
+    while (count > 1)
+      if (_count.compare_exchange_weak(count, count - 1,
+                                       std::memory_order_acq_rel))
+        return;
     std::unique_lock<std::mutex> lock(_condMut);
-    if (--_count == 0)
+    if (_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
       _cond.notify_all();
   }
 
+  /// \brief Returns true if the count is 0. Unlike sync(), this does not
+  ///   synchronize with a concurrent dec() that is still running.
+  bool done() const { return _count.load(std::memory_order_acquire) == 0; }
+
   void sync() const {
     std::unique_lock<std::mutex> lock(_condMut);
     _cond.wait(lock, [&] {
-      return _count == 0;
+      return done();
     });
   }
 };
@@ -65,6 +80,13 @@ public:
 // Classes in this namespace are implementation details of this header.
 namespace internal {
 
+/// \brief Returns the number of threads requested for the default executor.
+///   0 means one thread per hardware thread.
+inline unsigned &defaultThreadCount() {
+  static unsigned count = 0;
+  return count;
+}
+
 /// \brief An abstract class that takes closures and runs them asynchronously.
 class Executor {
 public:
@@ -78,9 +100,11 @@ public:
   virtual void add(std::function<void()> func) {
     func();
   }
+
+  void wait(const Latch &latch) { latch.sync(); }
 };
 
-inline Executor *getDefaultExecutor() {
+inline SyncExecutor *getDefaultExecutor() {
   static SyncExecutor exec;
   return &exec;
 }
@@ -100,98 +124,385 @@ class ConcRTExecutor : public Executor {
   };
 
 public:
+  ConcRTExecutor() {
+    if (unsigned threadCount = defaultThreadCount())
+      concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(
+          1, concurrency::MaxConcurrency, threadCount));
+  }
+
   virtual void add(std::function<void()> func) {
     Concurrency::CurrentScheduler::ScheduleTask(Taskish::run,
         new (concurrency::Alloc(sizeof(Taskish))) Taskish(func));
   }
+
+  void wait(const Latch &latch) { latch.sync(); }
 };
 
-inline Executor *getDefaultExecutor() {
+inline ConcRTExecutor *getDefaultExecutor() {
   static ConcRTExecutor exec;
   return &exec;
 }
 #else
+/// \brief A closure stored in a fixed-size node. Closures whose captures fit
+///   in the node are stored inline, so spawning a task does not need a
+///   separate allocation as std::function would. Nodes are recycled by the
+///   workers that run them.
+class Task {
+  typedef void (*InvokeFn)(Task *);
+  static const size_t inlineSize = 48;
+
+public:
+  typedef std::aligned_storage<inlineSize>::type Storage;
+
+public:
+  template <class Fn> void init(Fn &&fn) {
+    typedef typename std::decay<Fn>::type F;
+    init<F>(std::forward<Fn>(fn),
+            std::integral_constant<bool, sizeof(F) <= sizeof(Storage) &&
+                                             alignof(F) <= alignof(Storage)>());
+  }
+
+  /// \brief Runs the closure and destroys it. The node can then be reused.
+  void run() { _invoke(this); }
+
+  Task *_next = nullptr;
+
+private:
+  // Stores the closure inline.
+  template <class F, class Fn> void init(Fn &&fn, std::true_type) {
+    new (&_storage) F(std::forward<Fn>(fn));
+    _invoke = [](Task *t) {
+      F *f = reinterpret_cast<F *>(&t->_storage);
+      (*f)();
+      f->~F();
+    };
+  }
+
+  // Stores a pointer to a heap-allocated closure.
+  template <class F, class Fn> void init(Fn &&fn, std::false_type) {
+    *reinterpret_cast<F **>(&_storage) = new F(std::forward<Fn>(fn));
+    _invoke = [](Task *t) {
+      F *f = *reinterpret_cast<F **>(&t->_storage);
+      (*f)();
+      delete f;
+    };
+  }
+
+  Storage _storage;
+  InvokeFn _invoke;
+};
+
+/// \brief A Chase-Lev work-stealing deque.
+///
+/// The owning thread pushes and pops at the bottom; other threads steal from
+/// the top. Only steals and the pop of the last element use a CAS. The
+/// algorithm follows Le et al., "Correct and Efficient Work-Stealing for
+/// Weak Memory Models" (PPoPP 2013).
+class WorkStealingDeque {
+  class Array {
+  public:
+    explicit Array(int64_t size)
+        : _size(size), _buf(new std::atomic<Task *>[size]) {}
+
+    int64_t size() const { return _size; }
+
+    Task *get(int64_t i) const {
+      return _buf[i & (_size - 1)].load(std::memory_order_relaxed);
+    }
+
+    void put(int64_t i, Task *t) {
+      _buf[i & (_size - 1)].store(t, std::memory_order_relaxed);
+    }
+
+  private:
+    int64_t _size;
+    std::unique_ptr<std::atomic<Task *>[]> _buf;
+  };
+
+public:
+  WorkStealingDeque() : _top(0), _bottom(0) {
+    _arrays.emplace_back(new Array(256));
+    _array.store(_arrays.back().get(), std::memory_order_relaxed);
+  }
+
+  /// \brief Called only by the owner.
+  void push(Task *task) {
+    int64_t b = _bottom.load(std::memory_order_relaxed);
+    int64_t t = _top.load(std::memory_order_acquire);
+    Array *a = _array.load(std::memory_order_relaxed);
+    if (b - t > a->size() - 1) {
+      // Thieves may still be reading the old array, so it is kept alive
+      // until the deque is destroyed.
+      Array *bigger = new Array(a->size() * 2);
+      for (int64_t i = t; i != b; ++i)
+        bigger->put(i, a->get(i));
+      _arrays.emplace_back(bigger);
+      _array.store(bigger, std::memory_order_release);
+      a = bigger;
+    }
+    a->put(b, task);
+    _bottom.store(b + 1, std::memory_order_release);
+  }
+
+  /// \brief Called only by the owner.
+  Task *pop() {
+    int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+    Array *a = _array.load(std::memory_order_relaxed);
+    _bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = _top.load(std::memory_order_relaxed);
+    if (t > b) {
+      _bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    Task *task = a->get(b);
+    if (t == b) {
+      // This is the last element. Race against thieves for it.
+      if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed))
+        task = nullptr;
+      _bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  /// \brief May be called by any thread. Returns null if the deque is empty
+  ///   or if another thread won the race for the top element.
+  Task *steal() {
+    int64_t t = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = _bottom.load(std::memory_order_acquire);
+    if (t >= b)
+      return nullptr;
+    Array *a = _array.load(std::memory_order_acquire);
+    Task *task = a->get(t);
+    if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      return nullptr;
+    return task;
+  }
+
+  bool empty() const {
+    return _bottom.load(std::memory_order_seq_cst) <=
+           _top.load(std::memory_order_seq_cst);
+  }
+
+private:
+  std::atomic<int64_t> _top;
+  std::atomic<int64_t> _bottom;
+  std::atomic<Array *> _array;
+  std::vector<std::unique_ptr<Array>> _arrays;
+};
+
 /// \brief An implementation of an Executor that runs closures on a thread pool
-///   in filo order.
+///   with work stealing.
+///
+/// Each worker owns a deque. Tasks spawned by a worker go to the bottom of its
+/// own deque and are run in filo order, which keeps nested parallelism cache
+/// friendly. Idle workers steal from the top of other workers' deques. Tasks
+/// spawned by other threads go to a shared queue. A worker waiting for a
+/// TaskGroup runs other tasks instead of blocking.
 class ThreadPoolExecutor : public Executor {
+  struct Worker {
+    WorkStealingDeque deque;
+    Task *freeList = nullptr;
+    size_t index;
+  };
+
 public:
   explicit ThreadPoolExecutor(unsigned threadCount =
                                   std::thread::hardware_concurrency())
-      : _stop(false), _done(threadCount) {
+      : _stop(false), _sleepers(0), _injectedCount(0),
+        _done(std::max(threadCount, 1u)) {
+    threadCount = std::max(threadCount, 1u);
+    for (unsigned i = 0; i < threadCount; ++i) {
+      _workers.emplace_back(new Worker);
+      _workers.back()->index = i;
+    }
+
     // Spawn all but one of the threads in another thread as spawning threads
     // can take a while.
     std::thread([&, threadCount] {
       for (std::size_t i = 1; i < threadCount; ++i) {
+        Worker *w = _workers[i].get();
         std::thread([=] {
-          work();
+          work(w);
         }).detach();
       }
-      work();
+      work(_workers[0].get());
     }).detach();
   }
 
   ~ThreadPoolExecutor() override {
-    std::unique_lock<std::mutex> lock(_mutex);
+    std::unique_lock<std::mutex> lock(_sleepMutex);
     _stop = true;
     lock.unlock();
     _cond.notify_all();
     // Wait for ~Latch.
   }
 
-  void add(std::function<void()> f) override {
-    std::unique_lock<std::mutex> lock(_mutex);
-    _workStack.push(f);
-    lock.unlock();
-    _cond.notify_one();
+  void add(std::function<void()> f) override { add<>(std::move(f)); }
+
+  template <class Fn> void add(Fn &&fn) {
+    Worker *self = currentWorker();
+    Task *task = allocTask(self);
+    task->init(std::forward<Fn>(fn));
+    if (self) {
+      self->deque.push(task);
+    } else {
+      std::unique_lock<std::mutex> lock(_injectedMutex);
+      _injected.push_back(task);
+      _injectedCount.fetch_add(1);
+    }
+    wake();
+  }
+
+  /// \brief Waits for \p latch. A worker runs other tasks while waiting, so
+  ///   that waiting inside a task neither blocks a thread nor deadlocks.
+  void wait(const Latch &latch) {
+    Worker *self = currentWorker();
+    if (self) {
+      while (!latch.done()) {
+        if (Task *task = findWork(self))
+          runTask(self, task);
+        else
+          std::this_thread::yield();
+      }
+    }
+    latch.sync();
   }
 
 private:
-  void work() {
-    while (true) {
-      std::unique_lock<std::mutex> lock(_mutex);
-      _cond.wait(lock, [&] {
-        return _stop || !_workStack.empty();
-      });
-      if (_stop)
-        break;
-      auto task = _workStack.top();
-      _workStack.pop();
-      lock.unlock();
-      task();
+  static Worker *&currentWorker() {
+    static LLVM_THREAD_LOCAL Worker *worker = nullptr;
+    return worker;
+  }
+
+  Task *allocTask(Worker *self) {
+    if (self && self->freeList) {
+      Task *task = self->freeList;
+      self->freeList = task->_next;
+      return task;
+    }
+    return new Task;
+  }
+
+  void runTask(Worker *self, Task *task) {
+    task->run();
+    if (self) {
+      task->_next = self->freeList;
+      self->freeList = task;
+    } else {
+      delete task;
+    }
+  }
+
+  Task *popInjected() {
+    if (_injectedCount.load(std::memory_order_relaxed) == 0)
+      return nullptr;
+    std::unique_lock<std::mutex> lock(_injectedMutex);
+    if (_injected.empty())
+      return nullptr;
+    Task *task = _injected.front();
+    _injected.pop_front();
+    _injectedCount.fetch_sub(1);
+    return task;
+  }
+
+  Task *findWork(Worker *self) {
+    if (Task *task = self->deque.pop())
+      return task;
+    if (Task *task = popInjected())
+      return task;
+    // Start with the next worker so that thieves spread over victims.
+    size_t n = _workers.size();
+    for (size_t i = 1; i < n; ++i)
+      if (Task *task = _workers[(self->index + i) % n]->deque.steal())
+        return task;
+    return nullptr;
+  }
+
+  bool hasWork() const {
+    if (_injectedCount.load() != 0)
+      return true;
+    for (const std::unique_ptr<Worker> &w : _workers)
+      if (!w->deque.empty())
+        return true;
+    return false;
+  }
+
+  // Wakes up a sleeping worker if there is one. The fence pairs with the
+  // increment of _sleepers in work(): either the adder sees the sleeper, or
+  // the sleeper sees the new task in hasWork().
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleepers.load(std::memory_order_relaxed) == 0)
+      return;
+    std::unique_lock<std::mutex> lock(_sleepMutex);
+    _cond.notify_one();
+  }
+
+  void work(Worker *self) {
+    currentWorker() = self;
+    while (!_stop) {
+      if (Task *task = findWork(self)) {
+        runTask(self, task);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(_sleepMutex);
+      _sleepers.fetch_add(1);
+      if (!_stop && !hasWork())
+        _cond.wait(lock);
+      _sleepers.fetch_sub(1);
     }
     _done.dec();
   }
 
   std::atomic<bool> _stop;
-  std::stack<std::function<void()>> _workStack;
-  std::mutex _mutex;
+  std::atomic<unsigned> _sleepers;
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::deque<Task *> _injected;
+  std::atomic<size_t> _injectedCount;
+  std::mutex _injectedMutex;
+  std::mutex _sleepMutex;
   std::condition_variable _cond;
   Latch _done;
 };
 
-inline Executor *getDefaultExecutor() {
-  static ThreadPoolExecutor exec;
+inline ThreadPoolExecutor *getDefaultExecutor() {
+  static ThreadPoolExecutor exec(defaultThreadCount()
+                                     ? defaultThreadCount()
+                                     : std::thread::hardware_concurrency());
   return &exec;
 }
 #endif
 
 }  // namespace internal
 
+/// \brief Sets the number of threads used by parallel algorithms. 0 means one
+///   thread per hardware thread. This must be called before the first
+///   parallel algorithm runs; later calls have no effect.
+inline void setDefaultExecutorThreadCount(unsigned count) {
+  internal::defaultThreadCount() = count;
+}
+
 /// \brief Allows launching a number of tasks and waiting for them to finish
 ///   either explicitly via sync() or implicitly on destruction.
 class TaskGroup {
   Latch _latch;
 
 public:
-  void spawn(std::function<void()> f) {
+  ~TaskGroup() { sync(); }
+
+  template <class Fn> void spawn(Fn f) {
     _latch.inc();
-    internal::getDefaultExecutor()->add([&, f] {
+    internal::getDefaultExecutor()->add([this, f]() mutable {
       f();
       _latch.dec();
     });
   }
 
-  void sync() const { _latch.sync(); }
+  void sync() const { internal::getDefaultExecutor()->wait(_latch); }
 };
 
 #if !defined(LLVM_ENABLE_THREADS) || LLVM_ENABLE_THREADS == 0
@@ -292,6 +603,152 @@ void parallel_for_each(Iterator begin, Iterator end, Func func) {
   std::for_each(begin, end, func);
 }
 #endif
+
+namespace detail {
+template <class IndexTy, class Func>
+void parallel_for_range(IndexTy begin, IndexTy end, IndexTy grain,
+                        const Func &func, TaskGroup &tg) {
+  // Give away the upper half of the range until what is left is small
+  // enough. Halves spawned by a worker land in its own deque, where idle
+  // workers can steal them and split them further.
+  while (end - begin > grain) {
+    IndexTy mid = begin + (end - begin) / 2;
+    tg.spawn([=, &func, &tg] {
+      parallel_for_range(mid, end, grain, func, tg);
+    });
+    end = mid;
+  }
+  for (; begin != end; ++begin)
+    func(begin);
+}
+
+// The number of elements processed by one task in parallel_transform_reduce
+// and parallel_exclusive_scan. The partitioning depends only on the input
+// size, so results do not depend on the number of threads.
+const size_t reduceChunkSize = 1024;
+
+inline size_t getNumChunks(size_t size) {
+  return (size + reduceChunkSize - 1) / reduceChunkSize;
+}
+}
+
+/// \brief Calls \p func(i) for each index i in [\p begin, \p end). The range
+///   is split into tasks of at most \p grain indices. Use a small grain if
+///   each call is expensive.
+template <class IndexTy, class Func>
+void parallel_for(IndexTy begin, IndexTy end, IndexTy grain, Func func) {
+  if (begin >= end)
+    return;
+  TaskGroup tg;
+  detail::parallel_for_range(begin, end, std::max(grain, IndexTy(1)), func,
+                             tg);
+}
+
+/// \brief Calls \p produce(i) for each index i in [\p begin, \p end) in
+///   parallel, and \p consume(i) on the calling thread in increasing order
+///   of i.
+///
+/// consume(i) runs as soon as produce(i) has returned, while later calls of
+/// produce are still running. At most \p window calls of produce are started
+/// ahead of consume, which bounds the memory held by their results.
+template <class IndexTy, class ProduceFunc, class ConsumeFunc>
+void parallel_pipeline(IndexTy begin, IndexTy end, IndexTy window,
+                       ProduceFunc produce, ConsumeFunc consume) {
+  if (begin >= end)
+    return;
+  window = std::max(window, IndexTy(1));
+
+  // produce(i) counts down the latch in slot (i - begin) % window.
+  std::unique_ptr<Latch[]> slots(new Latch[window]);
+  auto start = [&](IndexTy i) {
+    Latch &slot = slots[(i - begin) % window];
+    slot.inc();
+    internal::getDefaultExecutor()->add([&produce, &slot, i] {
+      produce(i);
+      slot.dec();
+    });
+  };
+
+  IndexTy next = begin;
+  for (; next != end && next - begin < window; ++next)
+    start(next);
+  for (IndexTy i = begin; i != end; ++i) {
+    internal::getDefaultExecutor()->wait(slots[(i - begin) % window]);
+    consume(i);
+    if (next != end)
+      start(next++);
+  }
+}
+
+/// \brief Returns \p init combined with \p transform(x) for each element x
+///   in [\p begin, \p end) using \p reduce.
+///
+/// \p reduce must be associative. Elements are combined in fixed-size
+/// chunks, and the partial results are combined in order, so the result is
+/// deterministic even if \p reduce is not exactly associative (e.g. floating
+/// point addition).
+template <class Iterator, class T, class ReduceFunc, class TransformFunc>
+T parallel_transform_reduce(Iterator begin, Iterator end, T init,
+                            ReduceFunc reduce, TransformFunc transform) {
+  size_t size = std::distance(begin, end);
+  size_t numChunks = detail::getNumChunks(size);
+  std::vector<T> partials(numChunks, T());
+  parallel_for(size_t(0), numChunks, size_t(1), [&](size_t chunk) {
+    Iterator it = begin + chunk * detail::reduceChunkSize;
+    Iterator e = begin + std::min(size, (chunk + 1) * detail::reduceChunkSize);
+    T acc = transform(*it);
+    for (++it; it != e; ++it)
+      acc = reduce(acc, transform(*it));
+    partials[chunk] = acc;
+  });
+  for (T &partial : partials)
+    init = reduce(init, partial);
+  return init;
+}
+
+/// \brief Writes \p init combined with all elements before the i-th element
+///   of [\p begin, \p end) to \p out[i] using \p op, and returns \p init
+///   combined with all elements. \p out may be equal to \p begin.
+///
+/// \p op must be associative. Like parallel_transform_reduce, the partitioning
+/// depends only on the input size, so the result is deterministic.
+template <class Iterator, class OutIterator, class T, class BinaryOp>
+T parallel_exclusive_scan(Iterator begin, Iterator end, OutIterator out,
+                          T init, BinaryOp op) {
+  size_t size = std::distance(begin, end);
+  size_t numChunks = detail::getNumChunks(size);
+
+  // Compute the sum of each chunk.
+  std::vector<T> sums(numChunks, T());
+  parallel_for(size_t(0), numChunks, size_t(1), [&](size_t chunk) {
+    Iterator it = begin + chunk * detail::reduceChunkSize;
+    Iterator e = begin + std::min(size, (chunk + 1) * detail::reduceChunkSize);
+    T acc = *it;
+    for (++it; it != e; ++it)
+      acc = op(acc, *it);
+    sums[chunk] = acc;
+  });
+
+  // Turn them into the starting value of each chunk.
+  for (T &sum : sums) {
+    T next = op(init, sum);
+    sum = init;
+    init = next;
+  }
+
+  // Scan each chunk from its starting value.
+  parallel_for(size_t(0), numChunks, size_t(1), [&](size_t chunk) {
+    size_t i = chunk * detail::reduceChunkSize;
+    size_t e = std::min(size, i + detail::reduceChunkSize);
+    T acc = sums[chunk];
+    for (; i != e; ++i) {
+      T val = begin[i];
+      out[i] = acc;
+      acc = op(acc, val);
+    }
+  });
+  return init;
+}
 } // end namespace lld
 
 #endif // LLD_CORE_PARALLEL_H
@@ -16,6 +16,7 @@
 #include "lld/Core/ArchiveLibraryFile.h"
 #include "lld/Core/File.h"
 #include "lld/Core/Instrumentation.h"
+#include "lld/Core/Parallel.h"
 #include "lld/Core/PassManager.h"
 #include "lld/Core/Resolver.h"
 #include "lld/Core/SharedLibraryFile.h"
@@ -445,6 +446,17 @@ bool parse(llvm::ArrayRef<const char *> args, MachOLinkingContext &ctx,
     ctx.setBaseAddress(baseAddress);
   }
 
+  // Handle -threads N
+  if (llvm::opt::Arg *threads = parsedArgs.getLastArg(OPT_threads)) {
+    unsigned threadCount;
+    if (StringRef(threads->getValue()).getAsInteger(10, threadCount) ||
+        threadCount == 0) {
+      diagnostics << "error: threads expects a positive number\n";
+      return false;
+    }
+    setDefaultExecutorThreadCount(threadCount);
+  }
+
   // Handle -dead_strip
   if (parsedArgs.getLastArg(OPT_dead_strip))
     ctx.setDeadStripping(true);
@@ -16,8 +16,10 @@
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include <memory>
 #include <set>
 #include <unordered_map>
@@ -50,14 +52,13 @@ public:
     if (ci->getError())
       return nullptr;
 
-    // Don't return a member already returned
-    ErrorOr<StringRef> buf = (*ci)->getBuffer();
-    if (!buf)
+    // Don't return a member already returned. Members are identified by
+    // offset, because a member of a thin archive is mapped from its own
+    // file each time its buffer is requested.
+    uint64_t memberOffset = (*ci)->getChildOffset();
+    if (_membersInstantiated.count(memberOffset))
       return nullptr;
-    const char *memberStart = buf->data();
-    if (_membersInstantiated.count(memberStart))
-      return nullptr;
-    _membersInstantiated.insert(memberStart);
+    _membersInstantiated.insert(memberOffset);
 
     std::unique_ptr<File> result;
     if (instantiateMember(ci, result))
@@ -80,6 +81,13 @@ public:
       std::unique_ptr<File> file;
       if (std::error_code ec = instantiateMember(mf, file))
         return ec;
+      // Members of nested archives are returned in place of the archive.
+      if (auto *archive = dyn_cast<ArchiveLibraryFile>(file.get())) {
+        if (std::error_code ec = archive->parseAllMembers(result))
+          return ec;
+        _filesReturned.push_back(std::move(file));
+        continue;
+      }
       result.push_back(std::move(file));
     }
     return std::error_code();
@@ -136,8 +144,21 @@ private:
     if (_logLoading)
       llvm::errs() << memberPath << "\n";
 
+    // A nested archive is identified by its path relative to the directory
+    // of this archive, so that the members of a nested thin archive, which
+    // are looked up relative to its own directory, are found.
+    std::string identifier = mb.getBufferIdentifier();
+    if (llvm::sys::fs::identify_magic(mb.getBuffer()) ==
+            llvm::sys::fs::file_magic::archive &&
+        !llvm::sys::path::is_absolute(identifier)) {
+      SmallString<128> path =
+          llvm::sys::path::parent_path(_archive->getFileName());
+      llvm::sys::path::append(path, identifier);
+      identifier = path.str();
+    }
+
     std::unique_ptr<MemoryBuffer> memberMB(MemoryBuffer::getMemBuffer(
-        mb.getBuffer(), mb.getBufferIdentifier(), false));
+        mb.getBuffer(), identifier, false));
 
     ErrorOr<std::unique_ptr<File>> fileOrErr =
         _registry.loadFile(std::move(memberMB));
@@ -175,7 +196,7 @@ private:
   }
 
   typedef std::unordered_map<StringRef, Archive::child_iterator> MemberMap;
-  typedef std::set<const char *> InstantiatedSet;
+  typedef std::set<uint64_t> InstantiatedSet;
 
   std::shared_ptr<MemoryBuffer> _mb;
   const Registry &_registry;
@@ -0,0 +1,2 @@
+        .section .rodata.str,"aMSG",@progbits,1,foo,comdat
+        .ascii "abc"
@@ -0,0 +1,3 @@
+.globl bar
+bar:
+  ret
@@ -0,0 +1,17 @@
+# REQUIRES: x86, shell
+
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %S/Inputs/archive.s -o %t2
+# RUN: rm -rf %t.cache %tar
+# RUN: llvm-ar rcs %tar %t2
+# RUN: ld.lld --archive-index-cache=%t.cache %t %tar -o %tout1
+
+# A cache file whose contents do not match its checksum is not used.
+# Overwrite the hash value of the first symbol in the cache file, which
+# follows a 40-byte header and the first 16 bytes of the entry.
+# RUN: printf 'abcd' | dd of=`echo %t.cache/*.idx` bs=1 seek=56 count=4 \
+# RUN:   conv=notrunc 2> /dev/null
+# RUN: ld.lld --archive-index-cache=%t.cache %t %tar -o %tout2
+# RUN: cmp %tout1 %tout2
+
+.quad end
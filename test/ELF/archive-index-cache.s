@@ -0,0 +1,43 @@
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %S/Inputs/archive.s -o %t2
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %S/Inputs/archive2.s -o %t3
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %S/Inputs/archive3.s -o %t4
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %S/Inputs/archive4.s -o %t5
+# RUN: rm -rf %t.cache %tar
+# RUN: llvm-ar rcs %tar %t2 %t3 %t4
+# REQUIRES: x86
+
+# The first link creates a cache file, and the second one uses it.
+# RUN: ld.lld --archive-index-cache=%t.cache %t %tar %t5 -o %tout1
+# RUN: ls %t.cache | FileCheck --check-prefix=FILES %s
+# RUN: ld.lld --archive-index-cache=%t.cache %t %tar %t5 -o %tout2
+# RUN: cmp %tout1 %tout2
+# RUN: llvm-nm %tout2 | FileCheck %s
+
+# FILES: .idx
+
+# CHECK:      T _start
+# CHECK-NEXT: T bar
+# CHECK-NEXT: T end
+# CHECK-NEXT: w foo
+
+# A cache file is not used once the archive has changed.
+# RUN: rm -f %tar
+# RUN: llvm-ar rcs %tar %t2
+# RUN: ld.lld --archive-index-cache=%t.cache %t %tar -o %tout3
+# RUN: llvm-nm %tout3 | FileCheck --check-prefix=CHANGED %s
+
+# CHANGED:      T _start
+# CHANGED-NEXT: w bar
+# CHANGED-NEXT: T end
+# CHANGED-NEXT: w foo
+
+# Nothing here. Just needed for the linker to create a undefined _start symbol.
+
+.quad end
+
+.weak foo
+.quad foo
+
+.weak bar
+.quad bar
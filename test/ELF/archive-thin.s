@@ -0,0 +1,47 @@
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %S/Inputs/archive.s -o %t1.o
+# RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %S/Inputs/archive2.s -o %t2.o
+# RUN: rm -f %t.thin.a %t.inner.a %t.nested.a
+# RUN: llvm-ar rcsT %t.thin.a %t1.o %t2.o
+# REQUIRES: x86
+
+# Members of a thin archive are read from their own files.
+# RUN: ld.lld %t.o %t.thin.a -o %tout
+# RUN: llvm-nm %tout | FileCheck --check-prefix=LAZY %s
+# LAZY:      T _start
+# LAZY-NEXT: T end
+# LAZY-NEXT: w foo
+
+# RUN: ld.lld %t.o --whole-archive %t.thin.a -o %tout
+# RUN: llvm-nm %tout | FileCheck --check-prefix=WHOLE %s
+# WHOLE:      T _start
+# WHOLE-NEXT: T end
+# WHOLE-NEXT: T foo
+
+# Archives nested in archives are expanded by --whole-archive.
+# RUN: llvm-ar rcs %t.inner.a %t2.o
+# RUN: llvm-ar rcs %t.nested.a %t1.o %t.inner.a
+# RUN: ld.lld %t.o --whole-archive %t.nested.a -o %tout
+# RUN: llvm-nm %tout | FileCheck --check-prefix=WHOLE %s
+
+# Members of a nested thin archive are found relative to the directory of
+# the nested archive, not of the outer one or of the current directory.
+# RUN: rm -rf %t.dir && mkdir -p %t.dir/sub %t.dir/other
+# RUN: cp %t1.o %t.dir/start.o
+# RUN: cp %t2.o %t.dir/sub/foo.o
+# RUN: cd %t.dir/sub && llvm-ar rcsT inner.a foo.o
+# RUN: cd %t.dir && llvm-ar rcsT outer.a start.o sub/inner.a
+# RUN: cd %t.dir/other && ld.lld %t.o --whole-archive ../outer.a -o %tout
+# RUN: llvm-nm %tout | FileCheck --check-prefix=WHOLE %s
+
+# Without --whole-archive, only start.o is loaded. Members of nested
+# archives are not looked up lazily.
+# RUN: cd %t.dir/other && ld.lld %t.o ../outer.a -o %tout
+# RUN: llvm-nm %tout | FileCheck --check-prefix=LAZY %s
+
+# Nothing here. Just needed for the linker to create a undefined _start symbol.
+
+.quad end
+
+.weak foo
+.quad foo
@@ -34,3 +34,11 @@
 # AR-FIRST-NEXT: w bar
 # AR-FIRST-NEXT: T end
 # AR-FIRST-NEXT: w foo
+
+# With --threads, input files are prefetched in the background, and
+# --verbose reports how much of them was used.
+# RUN: ld.lld --threads --verbose %t %tar %t5 -o %tout \
+# RUN:   | FileCheck --check-prefix=PREFETCH %s
+# RUN: llvm-nm %tout | FileCheck %s
+
+# PREFETCH: prefetched {{[0-9]+}} bytes of input files, used {{[0-9]+}} bytes
@@ -2,9 +2,47 @@
 
 # RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux %s -o %t
 # RUN: ld.lld --build-id %t -o %t2
-# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=BUILDID %s
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=DEFAULT %s
+# RUN: ld.lld --build-id=fast %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=DEFAULT %s
+# RUN: ld.lld --build-id=md5 %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=MD5 %s
+# RUN: ld.lld --build-id=sha1 %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=SHA1 %s
+# RUN: ld.lld --build-id=uuid %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=UUID %s
+# RUN: ld.lld --build-id=0x12345678 %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=HEX %s
+# RUN: not ld.lld --build-id=0xabc %t -o %t2 2>&1 | FileCheck -check-prefix=BADHEX %s
+# RUN: not ld.lld --build-id=0x %t -o %t2 2>&1 | FileCheck -check-prefix=BADHEX %s
 # RUN: ld.lld %t -o %t2
-# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=NO-BUILDID %s
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=NONE %s
+# RUN: ld.lld --build-id=md5 --build-id=none %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=NONE %s
+# RUN: ld.lld --build-id --build-id=none %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=NONE %s
+# RUN: ld.lld --build-id=none --build-id %t -o %t2
+# RUN: llvm-objdump -s %t2 | FileCheck -check-prefix=DEFAULT %s
+
+## The build ID does not depend on --threads.
+# RUN: ld.lld --build-id=sha1 %t -o %t2
+# RUN: ld.lld --build-id=sha1 --threads %t -o %t3
+# RUN: cmp %t2 %t3
+
+## .debug_* sections are not hashed unless --build-id-debug is given.
+# RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux --defsym DEBUG2=1 %s -o %t.debug
+# RUN: ld.lld --build-id=md5 %t -o %t2
+# RUN: ld.lld --build-id=md5 %t.debug -o %t3
+# RUN: llvm-objdump -s -j .note.gnu.build-id %t2 > %t2.dump
+# RUN: llvm-objdump -s -j .note.gnu.build-id %t3 > %t3.dump
+# RUN: diff %t2.dump %t3.dump
+# RUN: ld.lld --build-id=md5 --build-id-debug %t -o %t2
+# RUN: ld.lld --build-id=md5 --build-id-debug %t.debug -o %t3
+# RUN: llvm-objdump -s -j .note.gnu.build-id %t2 > %t2.dump
+# RUN: llvm-objdump -s -j .note.gnu.build-id %t3 > %t3.dump
+# RUN: not diff %t2.dump %t3.dump
+
+# RUN: not ld.lld --build-id=foo %t -o %t2 2>&1 | FileCheck -check-prefix=ERR %s
 
 .globl _start;
 _start:
@@ -13,8 +51,31 @@ _start:
 .section .note.test, "a", @note
    .quad 42
 
-# BUILDID:      Contents of section .note.gnu.build-id:
-# BUILDID-NEXT: 04000000 08000000 03000000 474e5500  ............GNU.
-# BUILDID:      Contents of section .note.test:
+.section .debug_foo, "", @progbits
+.ifdef DEBUG2
+   .quad 2
+.else
+   .quad 1
+.endif
+
+# DEFAULT:      Contents of section .note.gnu.build-id:
+# DEFAULT-NEXT: 04000000 08000000 03000000 474e5500  ............GNU.
+
+# MD5:      Contents of section .note.gnu.build-id:
+# MD5-NEXT: 04000000 10000000 03000000 474e5500  ............GNU.
+
+# SHA1:      Contents of section .note.gnu.build-id:
+# SHA1-NEXT: 04000000 14000000 03000000 474e5500  ............GNU.
+
+# UUID:      Contents of section .note.gnu.build-id:
+# UUID-NEXT: 04000000 10000000 03000000 474e5500  ............GNU.
+
+# BADHEX: --build-id: invalid hexadecimal string
+
+# HEX:      Contents of section .note.gnu.build-id:
+# HEX-NEXT: 04000000 04000000 03000000 474e5500  ............GNU.
+# HEX-NEXT: 12345678
+
+# NONE-NOT: Contents of section .note.gnu.build-id:
 
-# NO-BUILDID-NOT: Contents of section .note.gnu.build-id:
+# ERR: unknown --build-id style: foo
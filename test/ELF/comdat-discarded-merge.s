@@ -0,0 +1,20 @@
+// REQUIRES: x86
+// RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t.o
+// RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux \
+// RUN:   %p/Inputs/comdat-discarded-merge.s -o %t2.o
+// RUN: ld.lld %t.o %t2.o -o %t
+// RUN: ld.lld --threads %t.o %t2.o -o %t.threads
+// RUN: cmp %t %t.threads
+// RUN: not ld.lld %t2.o %t.o -o %t 2>&1 | FileCheck %s
+// RUN: not ld.lld --threads %t2.o %t.o -o %t 2>&1 | FileCheck %s
+
+// The SHF_MERGE section in %t2.o is not null terminated. Its contents
+// are read only if its comdat group is the one that is kept.
+// CHECK: string is not null terminated
+
+        .globl _start
+_start:
+        nop
+
+        .section .rodata.str,"aMSG",@progbits,1,foo,comdat
+        .asciz "abc"
@@ -3,6 +3,8 @@
 // RUN: ld.lld -shared %t.o %t.o %t2.o -o %t
 // RUN: llvm-objdump -d %t | FileCheck %s
 // RUN: llvm-readobj -s -t %t | FileCheck --check-prefix=READ %s
+// RUN: ld.lld -shared --threads %t.o %t.o %t2.o -o %t.threads
+// RUN: cmp %t %t.threads
 // REQUIRES: x86
 
         .section	.text2,"axG",@progbits,foo,comdat,unique,0
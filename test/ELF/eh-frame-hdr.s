@@ -4,6 +4,8 @@
 // RUN: llvm-readobj -file-headers -s -section-data -program-headers -symbols %t | FileCheck %s --check-prefix=NOHDR
 // RUN: ld.lld --eh-frame-hdr %t.o -o %t
 // RUN: llvm-readobj -file-headers -s -section-data -program-headers -symbols %t | FileCheck %s --check-prefix=HDR
+// RUN: ld.lld --eh-frame-hdr --threads %t.o -o %t.threads
+// RUN: cmp %t %t.threads
 // RUN: llvm-objdump -d %t | FileCheck %s --check-prefix=HDRDISASM
 
 .section foo,"ax",@progbits
@@ -2,6 +2,9 @@
 // RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t.o
 // RUN: ld.lld %t.o %t.o -o %t -shared
 // RUN: llvm-readobj -s -section-data %t | FileCheck %s
+// RUN: ld.lld --eh-frame-hdr %t.o %t.o -o %t1 -shared
+// RUN: ld.lld --eh-frame-hdr --threads %t.o %t.o -o %t2 -shared
+// RUN: cmp %t1 %t2
 
         .section	foo,"ax",@progbits
 	.cfi_startproc
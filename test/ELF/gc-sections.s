@@ -5,6 +5,8 @@
 # RUN: llvm-readobj -sections -symbols %t2 | FileCheck -check-prefix=NOGC %s
 # RUN: ld.lld --gc-sections %t -o %t2
 # RUN: llvm-readobj -sections -symbols %t2 | FileCheck -check-prefix=GC1 %s
+# RUN: ld.lld --gc-sections --threads %t -o %t3
+# RUN: cmp %t2 %t3
 # RUN: ld.lld --export-dynamic --gc-sections %t -o %t2
 # RUN: llvm-readobj -sections -symbols %t2 | FileCheck -check-prefix=GC2 %s
 
@@ -0,0 +1,73 @@
+# REQUIRES: x86
+
+# RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux %s -o %t
+# RUN: ld.lld %t -o %t2 --icf=all --print-icf-sections 2>&1 \
+# RUN:   | FileCheck -check-prefix=ALL %s
+# RUN: ld.lld %t -o %t2 --icf=all --icf-data --export-dynamic \
+# RUN:   --print-icf-sections 2>&1 | FileCheck %s
+
+# Without --icf-data, all read-only sections are folded as before.
+
+# ALL:      selected section '.rodata.a' in file
+# ALL-NEXT:   removing identical section '.rodata.b' in file
+# ALL-NEXT:   removing identical section '.rodata.c' in file
+# ALL-NEXT:   removing identical section '.rodata.d' in file
+# ALL-NEXT:   removing identical section '.rodata.e' in file
+# ALL-NEXT:   removing identical section '.rodata.f' in file
+# ALL-NEXT:   removing identical section '.rodata.g' in file
+# ALL-NEXT:   removing identical section '.rodata.h' in file
+
+# CHECK:      selected section '.rodata.a' in file
+# CHECK-NEXT:   removing identical section '.rodata.b' in file
+# CHECK-NOT:  section
+
+.globl _start, e, f
+_start:
+  movq a(%rip), %rax
+  cmpq b(%rip), %rax
+  movq e(%rip), %rax
+  movq f(%rip), %rax
+  leaq g(%rip), %rax
+  leaq h(%rip), %rax
+  ret
+
+# Only loaded from code. These can be folded.
+.section .rodata.a, "a"
+a:
+  .quad 42
+
+.section .rodata.b, "a"
+b:
+  .quad 42
+
+# Addresses are stored to .data.
+.section .rodata.c, "a"
+c:
+  .quad 42
+
+.section .rodata.d, "a"
+d:
+  .quad 42
+
+# Exported.
+.section .rodata.e, "a"
+e:
+  .quad 42
+
+.section .rodata.f, "a"
+f:
+  .quad 42
+
+# Addresses are computed with PC-relative relocations, just like the loads
+# above.
+.section .rodata.g, "a"
+g:
+  .quad 42
+
+.section .rodata.h, "a"
+h:
+  .quad 42
+
+.data
+  .quad c
+  .quad d
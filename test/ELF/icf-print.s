@@ -0,0 +1,36 @@
+# REQUIRES: x86
+
+# RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux %s -o %t
+# RUN: ld.lld %t -o %t2 --icf=all --print-icf-sections 2>&1 \
+# RUN:   | FileCheck %s
+# RUN: ld.lld %t -o %t3 --icf=all --threads
+# RUN: cmp %t2 %t3
+
+# CHECK:      selected section '.text.f1' in file
+# CHECK-NEXT:   removing identical section '.text.f2' in file
+# CHECK-NEXT:   removing identical section '.text.f3' in file
+# CHECK-NOT:  .text.f4
+
+.globl _start, f1, f2, f3, f4
+_start:
+  ret
+
+.section .text.f1, "ax"
+f1:
+  mov $60, %rdi
+  call f2
+
+.section .text.f2, "ax"
+f2:
+  mov $60, %rdi
+  call f3
+
+.section .text.f3, "ax"
+f3:
+  mov $60, %rdi
+  call f1
+
+.section .text.f4, "ax"
+f4:
+  mov $61, %rdi
+  call f1
@@ -0,0 +1,78 @@
+// REQUIRES: x86
+
+// RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux %s -o %t.o
+// RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux \
+// RUN:   %p/Inputs/shared.s -o %t1.o
+// RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux \
+// RUN:   %p/Inputs/shared2.s -o %t2.o
+// RUN: rm -f %t1.a
+// RUN: llvm-ar rcs %t1.a %t1.o
+// RUN: ld.lld -shared %t2.o -soname shared2 -o %t2.so
+
+/// Symbols are looked up through .gnu.hash, .hash, or .gnu.hash if the
+/// file has both. The output must be the same as without the option.
+/// %t1.a is not loaded because bar and zed are defined by shared1.
+
+// RUN: ld.lld -shared %t1.o -soname shared1 --hash-style=gnu -o %t-gnu.so
+// RUN: ld.lld --as-needed %t.o %t-gnu.so %t2.so %t1.a -o %t.exp
+// RUN: ld.lld --lazy-shared-symbols --as-needed %t.o %t-gnu.so %t2.so \
+// RUN:   %t1.a -o %t.out
+// RUN: cmp %t.exp %t.out
+// RUN: ld.lld --lazy-shared-symbols --threads --as-needed %t.o %t-gnu.so \
+// RUN:   %t2.so %t1.a -o %t.out
+// RUN: cmp %t.exp %t.out
+// RUN: llvm-readobj -dyn-symbols %t.out | FileCheck --check-prefix=DYNSYM %s
+// RUN: llvm-readobj -dynamic-table %t.out | FileCheck %s
+
+// RUN: ld.lld -shared %t1.o -soname shared1 --hash-style=sysv -o %t-sysv.so
+// RUN: ld.lld --as-needed %t.o %t-sysv.so %t2.so %t1.a -o %t.exp
+// RUN: ld.lld --lazy-shared-symbols --as-needed %t.o %t-sysv.so %t2.so \
+// RUN:   %t1.a -o %t.out
+// RUN: cmp %t.exp %t.out
+
+// RUN: ld.lld -shared %t1.o -soname shared1 --hash-style=both -o %t-both.so
+// RUN: ld.lld --as-needed %t.o %t-both.so %t2.so %t1.a -o %t.exp
+// RUN: ld.lld --lazy-shared-symbols --as-needed %t.o %t-both.so %t2.so \
+// RUN:   %t1.a -o %t.out
+// RUN: cmp %t.exp %t.out
+
+/// If the DSOs come before the object file, symbols are imported from them
+/// in the order in which the object file refers to them, so the symbol
+/// tables may be ordered differently. They contain the same symbols.
+
+// RUN: ld.lld --as-needed %t-gnu.so %t2.so %t.o %t1.a -o %t.exp
+// RUN: llvm-readobj -dyn-symbols %t.exp | FileCheck --check-prefix=FIRST %s
+// RUN: llvm-readobj -dynamic-table %t.exp | FileCheck %s
+// RUN: ld.lld --lazy-shared-symbols --as-needed %t-gnu.so %t2.so %t.o \
+// RUN:   %t1.a -o %t.out
+// RUN: llvm-readobj -dyn-symbols %t.out | FileCheck --check-prefix=FIRST %s
+// RUN: llvm-readobj -dynamic-table %t.out | FileCheck %s
+
+// FIRST:      DynamicSymbols [
+// FIRST-DAG:    Name: bar@
+// FIRST-DAG:    Name: bar2@
+// FIRST-DAG:    Name: zed@
+// FIRST:      ]
+
+/// bar2 is exported because the DSOs also define it, and unused DSOs
+/// are still dropped by --as-needed.
+
+// DYNSYM:      DynamicSymbols [
+// DYNSYM:        Name: bar2
+// DYNSYM-NEXT:   Value:
+// DYNSYM-NEXT:   Size:
+// DYNSYM-NEXT:   Binding: Global
+// DYNSYM-NEXT:   Type: None
+// DYNSYM-NEXT:   Other:
+// DYNSYM-NEXT:   Section: .text
+
+// CHECK:      NEEDED SharedLibrary (shared1)
+// CHECK-NOT:  NEEDED SharedLibrary (shared2)
+
+.global _start
+_start:
+  call bar
+  call zed
+
+.global bar2
+bar2:
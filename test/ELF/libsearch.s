@@ -67,6 +67,14 @@
 // RUN: ld.lld -o %t3 %t.o -L%t.dir -Bstatic -lls -Bdynamic
 // RUN: llvm-readobj --symbols %t3 | FileCheck --check-prefix=STATIC %s
 
+// Files read ahead with --threads are searched for in the same way
+// RUN: ld.lld --threads -o %t3 %t.o -L%t.dir -lls -Bstatic -Bdynamic
+// RUN: llvm-readobj --symbols %t3 | FileCheck --check-prefix=DYNAMIC %s
+// RUN: ld.lld --threads -o %t3 %t.o -L%t.dir -Bstatic -lls -Bdynamic
+// RUN: llvm-readobj --symbols %t3 | FileCheck --check-prefix=STATIC %s
+// RUN: not ld.lld --threads -o %t3 %t.o -L%t.dir -Bstatic -lls2 2>&1 \
+// RUN:   | FileCheck --check-prefix=NOLIB2 %s
+
 // Check aliases as well
 // RUN: ld.lld -o %t3 %t.o -L%t.dir -dn -lls
 // RUN: llvm-readobj --symbols %t3 | FileCheck --check-prefix=STATIC %s
@@ -0,0 +1,44 @@
+// REQUIRES: x86
+// RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t.o
+// RUN: ld.lld %t.o -o %t.so -shared
+// RUN: llvm-readobj -s -section-data %t.so | FileCheck %s
+// RUN: ld.lld --threads %t.o -o %t2.so -shared
+// RUN: cmp %t.so %t2.so
+// RUN: ld.lld --threads=2 %t.o -o %t3.so -shared
+// RUN: cmp %t.so %t3.so
+
+// Characters wider than one byte may contain zero bytes. Only
+// characters whose bytes are all zero terminate strings.
+
+        .section .rodata.str2.2,"aMS",@progbits,2
+        .align 2
+        .short 0x100, 0x61, 0x62, 0x63, 0x64, 0
+        .short 0x100, 0x61, 0x62, 0x63, 0x64, 0
+        .short 0x61, 0
+
+        .section .rodata.str4.4,"aMS",@progbits,4
+        .align 4
+        .long 0x10000, 1, 2, 0
+        .long 0x10000, 1, 2, 0
+        .long 3, 0
+
+// CHECK:      Name: .rodata
+// CHECK:      Size: 16
+// CHECK-NEXT: Link: 0
+// CHECK-NEXT: Info: 0
+// CHECK-NEXT: AddressAlignment: 2
+// CHECK-NEXT: EntrySize: 2
+// CHECK-NEXT: SectionData (
+// CHECK-NEXT:   0000: 00016100 62006300 64000000 61000000
+// CHECK-NEXT: )
+
+// CHECK:      Name: .rodata
+// CHECK:      Size: 24
+// CHECK-NEXT: Link: 0
+// CHECK-NEXT: Info: 0
+// CHECK-NEXT: AddressAlignment: 4
+// CHECK-NEXT: EntrySize: 4
+// CHECK-NEXT: SectionData (
+// CHECK-NEXT:   0000: 00000100 01000000 02000000 00000000
+// CHECK-NEXT:   0010: 03000000 00000000
+// CHECK-NEXT: )
@@ -2,8 +2,12 @@
 // RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t.o
 // RUN: ld.lld -O2 %t.o -o %t.so -shared
 // RUN: llvm-readobj -s -section-data -t %t.so | FileCheck %s
+// RUN: ld.lld -O2 --threads %t.o -o %t2.so -shared
+// RUN: cmp %t.so %t2.so
 // RUN: ld.lld -O1 %t.o -o %t.so -shared
 // RUN: llvm-readobj -s -section-data -t %t.so | FileCheck --check-prefix=NOTAIL %s
+// RUN: ld.lld -O1 --threads %t.o -o %t2.so -shared
+// RUN: cmp %t.so %t2.so
 
         .section	.rodata.str1.1,"aMS",@progbits,1
 	.asciz	"abc"
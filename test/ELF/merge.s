@@ -2,6 +2,8 @@
 // RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t.o
 // RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %p/Inputs/merge.s -o %t2.o
 // RUN: ld.lld %t.o %t2.o -o %t
+// RUN: ld.lld --threads %t.o %t2.o -o %t.threads
+// RUN: cmp %t %t.threads
 // RUN: llvm-readobj -s -section-data -t %t | FileCheck %s
 // RUN: llvm-objdump -d %t | FileCheck --check-prefix=DISASM %s
 
@@ -5,6 +5,11 @@
 # RUN: llvm-objdump -d -t %t.so | FileCheck %s
 # RUN: llvm-readobj -r -mips-plt-got %t.so | FileCheck -check-prefix=GOT %s
 
+# Local GOT entries are created while .text is relocated, so .got must be
+# written after it with --threads as well.
+# RUN: ld.lld %t.o -shared --threads -o %t2.so
+# RUN: cmp %t.so %t2.so
+
 # REQUIRES: mips
 
 # CHECK:      Disassembly of section .text:
@@ -3,6 +3,10 @@
 // RUN: ld.lld -shared %t2.o -o %t2.so
 // RUN: ld.lld -shared %t.o %t2.so -o %t
 // RUN: ld.lld %t.o %t2.so -o %t3
+// RUN: ld.lld --threads -shared %t.o %t2.so -o %t.threads
+// RUN: cmp %t %t.threads
+// RUN: ld.lld --threads %t.o %t2.so -o %t3.threads
+// RUN: cmp %t3 %t3.threads
 // RUN: llvm-readobj -s -r %t | FileCheck %s
 // RUN: llvm-objdump -d %t | FileCheck --check-prefix=DISASM %s
 // RUN: llvm-readobj -s -r %t3 | FileCheck --check-prefix=CHECK2 %s
@@ -0,0 +1,76 @@
+// REQUIRES: x86
+// RUN: llvm-mc -filetype=obj -triple=x86_64-pc-linux %s -o %t.o
+// RUN: ld.lld %t.o -o %t
+// RUN: llvm-readobj -s %t > %t.sections
+// RUN: FileCheck --check-prefix=DATA %s < %t.sections
+// RUN: FileCheck --check-prefix=INIT %s < %t.sections
+// RUN: FileCheck --check-prefix=CTORS %s < %t.sections
+// RUN: ld.lld --threads %t.o -o %t2
+// RUN: cmp %t %t2
+
+// Each output section below has more than 10000 input sections, so
+// their offsets are assigned in more than one group. .init_array and
+// .ctors are sorted by priority and laid out again after that.
+
+// The second group of .data starts at a multiple of the largest
+// alignment in that group, so there are 7 bytes of padding before it
+// that a one-by-one layout would not have.
+// DATA:      Name: .data
+// DATA-NOT:  Name:
+// DATA:      Size: 40017
+
+// INIT:      Name: .init_array
+// INIT-NOT:  Name:
+// INIT:      Size: 80016
+
+// CTORS:     Name: .ctors
+// CTORS-NOT: Name:
+// CTORS:     Size: 80016
+
+.globl _start
+_start:
+  nop
+
+.macro data1
+.section .data.sec,"aw",@progbits,unique,\@
+.byte 1, 2, 3
+.endm
+
+.macro data8
+.section .data.sec,"aw",@progbits,unique,\@
+.p2align 3
+.byte 4
+.endm
+
+.macro init
+.section .init_array.\@,"aw",@init_array
+.p2align 3
+.quad 1
+.endm
+
+.macro init_noprio
+.section .init_array,"aw",@init_array,unique,\@
+.p2align 3
+.quad 2
+.endm
+
+.macro ctor
+.section .ctors.\@,"aw",@progbits
+.p2align 3
+.quad 3
+.endm
+
+.macro ctor_noprio
+.section .ctors,"aw",@progbits,unique,\@
+.p2align 3
+.quad 4
+.endm
+
+.rept 5001
+data1
+data8
+init_noprio
+init
+ctor_noprio
+ctor
+.endr
@@ -0,0 +1,47 @@
+// REQUIRES: x86
+
+// RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux %s -o %t1.o
+// RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux \
+// RUN:   %p/Inputs/start-lib1.s -o %t2.o
+// RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux \
+// RUN:   %p/Inputs/start-lib2.s -o %t3.o
+
+// RUN: ld.lld -o %t.exe %t1.o %t2.o %t3.o
+// RUN: llvm-nm %t.exe | FileCheck --check-prefix=TEST1 %s
+// TEST1: T bar
+// TEST1: T foo
+
+// Nothing refers to foo or bar, so neither object file is loaded.
+// RUN: ld.lld -o %t.exe %t1.o --start-lib %t2.o %t3.o --end-lib
+// RUN: llvm-nm %t.exe | FileCheck --check-prefix=TEST2 %s
+// TEST2-NOT: {{bar|foo}}
+
+// foo is loaded, and it pulls in bar.
+// RUN: ld.lld -o %t.exe %t1.o -u foo --start-lib %t2.o %t3.o --end-lib
+// RUN: llvm-nm %t.exe | FileCheck --check-prefix=TEST3 %s
+// TEST3: T bar
+// TEST3: T foo
+
+// Only bar is loaded.
+// RUN: ld.lld -o %t.exe %t1.o -u bar --start-lib %t2.o %t3.o --end-lib
+// RUN: llvm-nm %t.exe | FileCheck --check-prefix=TEST4 %s
+// TEST4: T bar
+// TEST4-NOT: foo
+
+// No object file is loaded at all. The target is still known from the
+// lazy object file.
+// RUN: ld.lld -shared -o %t.so --start-lib %t2.o --end-lib
+// RUN: llvm-readobj -file-headers %t.so | FileCheck --check-prefix=NOOBJ %s
+// NOOBJ: OS/ABI: SystemV
+// NOOBJ: Machine: EM_X86_64
+
+// RUN: not ld.lld -o %t.exe %t1.o --start-lib --start-lib %t2.o 2>&1 \
+// RUN:   | FileCheck --check-prefix=NESTED %s
+// NESTED: nested --start-lib
+
+// RUN: not ld.lld -o %t.exe %t1.o --end-lib %t2.o 2>&1 \
+// RUN:   | FileCheck --check-prefix=STRAY %s
+// STRAY: stray --end-lib
+
+.globl _start
+_start:
@@ -1,5 +1,7 @@
 // RUN: llvm-mc -filetype=obj -triple=x86_64-unknown-linux %s -o %t.o
 // RUN: ld.lld %t.o -o %t1
+// RUN: ld.lld --threads %t.o -o %t1.threads
+// RUN: cmp %t1 %t1.threads
 // RUN: llvm-readobj -r %t1 | FileCheck --check-prefix=NORELOC %s
 // RUN: llvm-objdump -d %t1 | FileCheck --check-prefix=DISASM %s
 
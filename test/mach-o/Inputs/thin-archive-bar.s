@@ -0,0 +1,3 @@
+  .globl _bar
+_bar:
+  ret
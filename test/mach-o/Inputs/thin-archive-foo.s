@@ -0,0 +1,3 @@
+  .globl _foo
+_foo:
+  jmp _bar
@@ -15,7 +15,9 @@
 #include "gtest/gtest.h"
 #include "lld/Core/Parallel.h"
 #include <array>
+#include <atomic>
 #include <random>
+#include <vector>
 
 uint32_t array[1024 * 1024];
 
@@ -29,3 +31,100 @@ TEST(Parallel, sort) {
   lld::parallel_sort(std::begin(array), std::end(array));
   ASSERT_TRUE(std::is_sorted(std::begin(array), std::end(array)));
 }
+
+TEST(Parallel, nestedTaskGroups) {
+  // Tasks that wait for their own subtasks must not deadlock, even if
+  // there are more of them than threads.
+  std::atomic<unsigned> count(0);
+  lld::TaskGroup outer;
+  for (int i = 0; i < 64; ++i) {
+    outer.spawn([&] {
+      lld::TaskGroup inner;
+      for (int j = 0; j < 64; ++j)
+        inner.spawn([&] { ++count; });
+      inner.sync();
+    });
+  }
+  outer.sync();
+  ASSERT_EQ(64u * 64u, count);
+}
+
+TEST(Parallel, parallelFor) {
+  std::vector<std::atomic<unsigned>> counts(10000);
+  for (auto &c : counts)
+    c = 0;
+  lld::parallel_for(size_t(0), counts.size(), size_t(7),
+                    [&](size_t i) { ++counts[i]; });
+  for (auto &c : counts)
+    ASSERT_EQ(1u, c);
+
+  // Empty ranges and zero grain sizes are valid.
+  lld::parallel_for(5, 5, 1, [](int) { FAIL(); });
+  unsigned n = 0;
+  lld::parallel_for(0, 1, 0, [&](int) { ++n; });
+  ASSERT_EQ(1u, n);
+}
+
+TEST(Parallel, transformReduce) {
+  std::vector<uint32_t> v(100000);
+  for (size_t i = 0; i < v.size(); ++i)
+    v[i] = i * 7 % 1000;
+  uint64_t expected = 10;
+  for (uint32_t x : v)
+    expected += x * 2;
+  uint64_t sum = lld::parallel_transform_reduce(
+      v.begin(), v.end(), uint64_t(10),
+      [](uint64_t a, uint64_t b) { return a + b; },
+      [](uint32_t x) { return uint64_t(x) * 2; });
+  ASSERT_EQ(expected, sum);
+
+  std::vector<uint32_t> empty;
+  ASSERT_EQ(42u, lld::parallel_transform_reduce(
+                     empty.begin(), empty.end(), 42u,
+                     [](uint32_t a, uint32_t b) { return a + b; },
+                     [](uint32_t x) { return x; }));
+}
+
+TEST(Parallel, exclusiveScan) {
+  std::vector<uint64_t> v(5000);
+  for (size_t i = 0; i < v.size(); ++i)
+    v[i] = i % 13;
+  std::vector<uint64_t> expected(v.size());
+  uint64_t acc = 100;
+  for (size_t i = 0; i < v.size(); ++i) {
+    expected[i] = acc;
+    acc += v[i];
+  }
+
+  std::vector<uint64_t> out(v.size());
+  auto add = [](uint64_t a, uint64_t b) { return a + b; };
+  ASSERT_EQ(acc, lld::parallel_exclusive_scan(v.begin(), v.end(), out.begin(),
+                                              uint64_t(100), add));
+  ASSERT_EQ(expected, out);
+
+  // In-place.
+  ASSERT_EQ(acc, lld::parallel_exclusive_scan(v.begin(), v.end(), v.begin(),
+                                              uint64_t(100), add));
+  ASSERT_EQ(expected, v);
+}
+
+TEST(Parallel, pipeline) {
+  std::vector<uint64_t> produced(3000);
+  std::vector<uint64_t> consumed;
+  std::atomic<size_t> inFlight(0);
+  std::atomic<bool> overrun(false);
+  lld::parallel_pipeline(size_t(0), produced.size(), size_t(8),
+                         [&](size_t i) {
+                           if (++inFlight > 8)
+                             overrun = true;
+                           produced[i] = i * i;
+                         },
+                         [&](size_t i) {
+                           --inFlight;
+                           consumed.push_back(produced[i]);
+                         });
+  ASSERT_FALSE(overrun);
+  ASSERT_EQ(produced.size(), consumed.size());
+  for (size_t i = 0; i < consumed.size(); ++i)
+    ASSERT_EQ(i * i, consumed[i]);
+}